@@ -0,0 +1,79 @@
+#include "arena.h"
+
+#include "stdbool.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+static ArenaBlock *block_new(unsigned long cap) {
+  ArenaBlock *b = malloc(sizeof(ArenaBlock) + cap);
+  if (b == NULL) {
+    fprintf(stderr, "Error allocating %lu bytes for arena\nExiting...\n", cap);
+    exit(EXIT_FAILURE);
+  }
+  b->next = NULL;
+  b->cap = cap;
+  b->used = 0;
+  return b;
+}
+
+// offset in b at which an allocation would start
+static unsigned long aligned_used(const ArenaBlock *b) {
+  const uintptr_t p = (uintptr_t)&b->data[b->used];
+  const uintptr_t aligned =
+      (p + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+  return b->used + (unsigned long)(aligned - p);
+}
+
+static bool fits(const ArenaBlock *b, unsigned long size) {
+  const unsigned long start = aligned_used(b);
+  return start <= b->cap && size <= b->cap - start;
+}
+
+Arena arena_new(unsigned long block_size) {
+  ArenaBlock *head = block_new(block_size);
+  return (Arena){.head = head, .cur = head, .block_size = block_size};
+}
+
+void *arena_alloc(Arena *a, unsigned long size) {
+  while (!fits(a->cur, size)) {
+    ArenaBlock *next = a->cur->next;
+    if (next == NULL || next->cap < size + ARENA_ALIGN) {
+      // worst case padding for the alignment of the new block
+      const unsigned long cap = size + ARENA_ALIGN > a->block_size
+                                    ? size + ARENA_ALIGN
+                                    : a->block_size;
+      ArenaBlock *b = block_new(cap);
+      b->next = next;
+      a->cur->next = b;
+      next = b;
+    }
+    next->used = 0;
+    a->cur = next;
+  }
+
+  const unsigned long start = aligned_used(a->cur);
+  a->cur->used = start + size;
+  return &a->cur->data[start];
+}
+
+void *arena_zalloc(Arena *a, unsigned long size) {
+  void *ret = arena_alloc(a, size);
+  memset(ret, 0x0, size);
+  return ret;
+}
+
+void arena_reset(Arena *a) {
+  a->cur = a->head;
+  a->head->used = 0;
+}
+
+void arena_free(Arena *a) {
+  ArenaBlock *b = a->head;
+  while (b != NULL) {
+    ArenaBlock *next = b->next;
+    free(b);
+    b = next;
+  }
+  *a = (Arena){0};
+}
@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "stdint.h"
+
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+  struct ArenaBlock *next;
+  unsigned long cap;
+  unsigned long used;
+  char data[];
+} ArenaBlock;
+
+/**
+ * Bump allocator for data that lives exactly as long as one lesson.
+ *
+ * Blocks are kept across resets, so after the first lesson a round does not
+ * call into malloc at all.
+ */
+typedef struct {
+  ArenaBlock *head;
+  ArenaBlock *cur;
+  unsigned long block_size;
+} Arena;
+
+/**
+ * @brief create arena with a first block of block_size bytes
+ */
+Arena arena_new(unsigned long block_size);
+
+/**
+ * @brief allocate size bytes aligned to ARENA_ALIGN, contents are undefined
+ */
+void *arena_alloc(Arena *a, unsigned long size);
+
+/**
+ * @brief allocate size zeroed bytes aligned to ARENA_ALIGN
+ */
+void *arena_zalloc(Arena *a, unsigned long size);
+
+/**
+ * @brief release all allocations at once, keeps the blocks for reuse
+ */
+void arena_reset(Arena *a);
+
+/**
+ * @brief free all blocks
+ */
+void arena_free(Arena *a);
+
+#endif // ARENA_H
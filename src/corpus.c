@@ -0,0 +1,294 @@
+#include "corpus.h"
+
+#include "assert.h"
+#include "errno.h"
+#include "fcntl.h"
+#include "file_util.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+
+typedef struct {
+  char word[CORPUS_MAX_WORD_LEN];
+  int len;
+  uint64_t hash;
+  long count;
+  long heap_pos;
+} Counter;
+
+/**
+ * Space-Saving top-K: a fixed number of counters, an open addressing table
+ * from word to counter and a min-heap of counters by count.
+ */
+typedef struct {
+  Counter *counters;
+  long n;
+  long cap;
+  long *heap;
+  long *table; //< counter id per slot, -1 if empty
+  uint64_t mask;
+} TopK;
+
+static uint64_t fnv1a(const char *word, int len) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < len; ++i) {
+    h ^= (unsigned char)word[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+static TopK TK_new(long cap) {
+  uint64_t n_slots = 1;
+  while (n_slots < 2 * (uint64_t)cap) {
+    n_slots <<= 1;
+  }
+  TopK ret = {
+      .counters = malloc((unsigned long)cap * sizeof(Counter)),
+      .cap = cap,
+      .heap = malloc((unsigned long)cap * sizeof(long)),
+      .table = malloc(n_slots * sizeof(long)),
+      .mask = n_slots - 1,
+  };
+  for (uint64_t i = 0; i < n_slots; ++i) {
+    ret.table[i] = -1;
+  }
+  return ret;
+}
+
+static void TK_free(TopK tk) {
+  free(tk.table);
+  free(tk.heap);
+  free(tk.counters);
+}
+
+static void heap_swap(TopK *tk, long a, long b) {
+  const long tmp = tk->heap[a];
+  tk->heap[a] = tk->heap[b];
+  tk->heap[b] = tmp;
+  tk->counters[tk->heap[a]].heap_pos = a;
+  tk->counters[tk->heap[b]].heap_pos = b;
+}
+
+static long heap_count(const TopK *tk, long pos) {
+  return tk->counters[tk->heap[pos]].count;
+}
+
+static void heap_up(TopK *tk, long pos) {
+  while (pos > 0 && heap_count(tk, (pos - 1) / 2) > heap_count(tk, pos)) {
+    heap_swap(tk, pos, (pos - 1) / 2);
+    pos = (pos - 1) / 2;
+  }
+}
+
+static void heap_down(TopK *tk, long pos) {
+  for (;;) {
+    long smallest = pos;
+    const long l = 2 * pos + 1;
+    const long r = 2 * pos + 2;
+    if (l < tk->n && heap_count(tk, l) < heap_count(tk, smallest)) {
+      smallest = l;
+    }
+    if (r < tk->n && heap_count(tk, r) < heap_count(tk, smallest)) {
+      smallest = r;
+    }
+    if (smallest == pos) {
+      return;
+    }
+    heap_swap(tk, pos, smallest);
+    pos = smallest;
+  }
+}
+
+// slot holding word, or the empty slot where it would be inserted
+static uint64_t TK_slot(const TopK *tk, const char *word, int len,
+                        uint64_t hash) {
+  uint64_t slot = hash & tk->mask;
+  for (;;) {
+    const long id = tk->table[slot];
+    if (id < 0) {
+      return slot;
+    }
+    const Counter *c = &tk->counters[id];
+    if (c->hash == hash && c->len == len &&
+        memcmp(c->word, word, (unsigned long)len) == 0) {
+      return slot;
+    }
+    slot = (slot + 1) & tk->mask;
+  }
+}
+
+// backward shift deletion, keeps probe sequences intact without tombstones
+static void TK_unlink(TopK *tk, long id) {
+  const Counter *c = &tk->counters[id];
+  uint64_t hole = TK_slot(tk, c->word, c->len, c->hash);
+  assert(tk->table[hole] == id);
+  tk->table[hole] = -1;
+
+  uint64_t slot = hole;
+  for (;;) {
+    slot = (slot + 1) & tk->mask;
+    const long moved = tk->table[slot];
+    if (moved < 0) {
+      return;
+    }
+    const uint64_t home = tk->counters[moved].hash & tk->mask;
+    // move back unless home lies cyclically in (hole, slot]
+    if (((slot - home) & tk->mask) >= ((slot - hole) & tk->mask)) {
+      tk->table[hole] = moved;
+      tk->table[slot] = -1;
+      hole = slot;
+    }
+  }
+}
+
+static void TK_observe(TopK *tk, const char *word, int len) {
+  const uint64_t hash = fnv1a(word, len);
+  uint64_t slot = TK_slot(tk, word, len, hash);
+
+  long id = tk->table[slot];
+  if (id >= 0) {
+    ++tk->counters[id].count;
+    heap_down(tk, tk->counters[id].heap_pos);
+    return;
+  }
+
+  if (tk->n < tk->cap) {
+    id = tk->n++;
+    tk->counters[id].count = 1;
+    tk->counters[id].heap_pos = id;
+    tk->heap[id] = id;
+  } else {
+    // evict the least frequent word, the newcomer inherits its count
+    id = tk->heap[0];
+    TK_unlink(tk, id);
+    slot = TK_slot(tk, word, len, hash);
+    ++tk->counters[id].count;
+  }
+
+  Counter *c = &tk->counters[id];
+  memcpy(c->word, word, (unsigned long)len);
+  c->len = len;
+  c->hash = hash;
+  tk->table[slot] = id;
+  heap_up(tk, c->heap_pos);
+  heap_down(tk, c->heap_pos);
+}
+
+static int counter_gt(const void *a, const void *b) {
+  const long ca = ((const Counter *)a)->count;
+  const long cb = ((const Counter *)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+
+static bool is_word_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '\'';
+}
+
+static void finish_token(TopK *tk, const char *token, int len) {
+  // apostrophes are only allowed inside words
+  int start = 0;
+  while (start < len && token[start] == '\'') {
+    ++start;
+  }
+  while (len > start && token[len - 1] == '\'') {
+    --len;
+  }
+  if (len > start) {
+    TK_observe(tk, &token[start], len - start);
+  }
+}
+
+WordList get_corpus_wordlist(const char *fname, long max_words) {
+  assert(max_words > 0);
+
+  errno = 0;
+  const int fd = open(fname, O_RDONLY);
+  exit_err_file("Error opening corpus file", fname);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  TopK tk = TK_new(max_words);
+  char *buf = malloc(CORPUS_BUF_SZ);
+
+  // token state carries over chunk boundaries
+  char token[CORPUS_MAX_WORD_LEN];
+  int token_len = 0;
+  bool overlong = false;
+
+  for (;;) {
+    const ssize_t n_read = read(fd, buf, CORPUS_BUF_SZ);
+    if (n_read < 0) {
+      if (errno == EINTR) {
+        errno = 0;
+        continue;
+      }
+      exit_err_file("Error reading corpus file", fname);
+    }
+    if (n_read == 0) {
+      break;
+    }
+
+    for (ssize_t i = 0; i < n_read; ++i) {
+      const char c = buf[i];
+      if (is_word_char(c)) {
+        if (token_len < CORPUS_MAX_WORD_LEN) {
+          token[token_len++] = c;
+        } else {
+          overlong = true;
+        }
+        continue;
+      }
+      if (token_len > 0 && !overlong) {
+        finish_token(&tk, token, token_len);
+      }
+      token_len = 0;
+      overlong = false;
+    }
+  }
+  if (token_len > 0 && !overlong) {
+    finish_token(&tk, token, token_len);
+  }
+
+  free(buf);
+  close(fd);
+
+  if (tk.n == 0) {
+    fprintf(stderr, "No words found in corpus file '%s'\nExiting...\n",
+            fname);
+    exit(EXIT_FAILURE);
+  }
+
+  qsort(tk.counters, (unsigned long)tk.n, sizeof(Counter), &counter_gt);
+
+  long nchars = 0;
+  for (long i = 0; i < tk.n; ++i) {
+    nchars += tk.counters[i].len + 1;
+  }
+
+  char *chars = malloc((unsigned long)nchars);
+  SL *words = malloc((unsigned long)tk.n * sizeof(SL));
+  CharMask *masks = malloc((unsigned long)tk.n * sizeof(CharMask));
+  float *freqs = malloc((unsigned long)tk.n * sizeof(float));
+  long cur_char = 0;
+  for (long i = 0; i < tk.n; ++i) {
+    const Counter *c = &tk.counters[i];
+    memcpy(&chars[cur_char], c->word, (unsigned long)c->len);
+    words[i] = (SL){.start = &chars[cur_char], .len = c->len};
+    masks[i] = CM_of_chars(c->word, c->len);
+    freqs[i] = (float)c->count;
+    cur_char += c->len;
+    chars[cur_char++] = '\n';
+  }
+
+  WordList ret = {
+      .chars = chars,
+      .words = words,
+      .masks = masks,
+      .freqs = freqs,
+      .nwords = tk.n,
+      .nchars = nchars,
+  };
+  TK_free(tk);
+  return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include "wordlist.h"
+
+#define CORPUS_BUF_SZ (1 << 16)
+#define CORPUS_MAX_WORD_LEN 32
+#define CORPUS_DEFAULT_WORDS 5000
+
+/**
+ * @brief build WordList from the most frequent words of an arbitrary text file
+ *
+ * The file is read in CORPUS_BUF_SZ chunks and tokenized incrementally into
+ * runs of ASCII letters, with apostrophes allowed inside words. Longer tokens
+ * than CORPUS_MAX_WORD_LEN are dropped. Only max_words counters are kept
+ * (Space-Saving top-K), so peak memory does not depend on the size of the
+ * file. Words are returned most frequent first, with their (approximate)
+ * counts as frequencies.
+ *
+ * @param fname text file to read
+ * @param max_words size of the vocabulary to keep
+ */
+WordList get_corpus_wordlist(const char *fname, long max_words);
+
+#endif // CORPUS_H
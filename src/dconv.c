@@ -1,29 +1,261 @@
-#include "stats.h"
+#include "dirent.h"
 #include "errno.h"
+#include "file_util.h"
+#include "history.h"
+#include "ngram.h"
+#include "pthread.h"
+#include "stats.h"
+#include "stdatomic.h"
 #include "stdlib.h"
+#include "string.h"
+#include "sys/stat.h"
+#include "store.h"
+#include "unistd.h"
 #include <stdio.h>
 
-int main(void) {
-  ConfMatrix confusions = {0};
-  BigramTable bt = {0};
-  MonoGramDataSummary mds = {0};
-
-  FILE *data_file = fopen(STORAGE_NAME, "r");
-  if (errno) {
-    if (errno == ENOENT) {
-      // file does not exist
-    } else {
-      fprintf(stderr, "Error opening storage file '%s': %s\nExiting...\n",
-              STORAGE_NAME, strerror(errno));
+// keys typed less often are left out of the worst key of a user
+#define MIN_KEY_OCCURRENCES 20
+
+typedef struct {
+  char **paths;
+  long n;
+  long cap;
+} PathList;
+
+/** per-user row of users.csv */
+typedef struct {
+  uint64_t lessons;
+  long keystrokes;
+  long misses;
+  double avg_time;
+  double p90_time;
+  double recent_err_rate;
+  char worst_key; //< highest recent error rate, 0 if too few keystrokes
+} UserSummary;
+
+/**
+ * Reduces the files paths[next...] into its own aggregate, so workers never
+ * share anything but the counter.
+ */
+typedef struct {
+  const PathList *paths;
+  UserSummary *summaries;
+  atomic_long *next;
+
+  ConfMatrix *confusions;
+  MonoGramDataSummary *mds;
+  BigramTable bt;
+} Worker;
+
+static void exit_err_dconv(const char *msg, const char *fname) {
+  fprintf(stderr, "%s '%s': %s\nExiting...\n", msg, fname, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+static void PL_add(PathList *l, const char *path) {
+  if (l->n == l->cap) {
+    l->cap = l->cap ? 2 * l->cap : 64;
+    l->paths = realloc(l->paths, (unsigned long)l->cap * sizeof(char *));
+  }
+  l->paths[l->n++] = strdup(path);
+}
+
+// files are taken as they are, directories are searched for stats files
+static void PL_collect(PathList *l, const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    exit_err_dconv("Error reading", path);
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    PL_add(l, path);
+    return;
+  }
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    exit_err_dconv("Error opening directory", path);
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+      continue;
+    }
+    const unsigned long len = strlen(path) + strlen(ent->d_name) + 2;
+    char *child = malloc(len);
+    snprintf(child, len, "%s/%s", path, ent->d_name);
+    if (stat(child, &st) == 0 &&
+        (S_ISDIR(st.st_mode) || strcmp(ent->d_name, STORAGE_NAME) == 0)) {
+      PL_collect(l, child);
+    }
+    free(child);
+  }
+  closedir(dir);
+}
+
+static int cmp_paths(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void PL_free(PathList *l) {
+  for (long i = 0; i < l->n; ++i) {
+    free(l->paths[i]);
+  }
+  free(l->paths);
+  *l = (PathList){0};
+}
+
+static UserSummary summarize(const StatsStore *s) {
+  const MonoGramDataSummary *mds = s->mds;
+  const uint32_t tick = (uint32_t)s->seq;
+  UserSummary ret = {.lessons = s->seq};
+
+  Dist all = {0};
+  double recent_occ = 0.0;
+  double recent_miss = 0.0;
+  double worst = -1.0;
+  for (int c = 0; c < N_CHARS; ++c) {
+    DIST_merge(&all, ret.keystrokes, &mds->latency[c],
+               mds->n_occurrences[c]);
+    ret.keystrokes += mds->n_occurrences[c];
+    ret.misses += mds->n_misses[c];
+
+    const double occ = EWMA_at(mds->recent_occurrences[c], tick);
+    const double miss = EWMA_at(mds->recent_misses[c], tick);
+    recent_occ += occ;
+    recent_miss += miss;
+    if (mds->n_occurrences[c] >= MIN_KEY_OCCURRENCES && miss / occ > worst) {
+      worst = miss / occ;
+      ret.worst_key = keys[c];
+    }
+  }
+  ret.avg_time = all.mean;
+  ret.p90_time = DIST_quantile(&all, 0.9);
+  ret.recent_err_rate = recent_occ > 0.0 ? recent_miss / recent_occ : 0.0;
+  return ret;
+}
+
+static void *aggregate(void *arg) {
+  Worker *w = arg;
+  long i;
+  while ((i = atomic_fetch_add(w->next, 1)) < w->paths->n) {
+    StatsStore s;
+    SS_read(&s, w->paths->paths[i]);
+    const uint32_t tick = (uint32_t)s.seq;
+
+    w->summaries[i] = summarize(&s);
+    merge_conf_matrix(w->confusions, s.confusions, tick);
+    MDS_merge(w->mds, s.mds, tick);
+    BT_merge(&w->bt, s.bt, tick);
+    SS_close(&s);
+  }
+  return NULL;
+}
+
+static void write_users_csv(const PathList *paths,
+                            const UserSummary *summaries) {
+  FILE *users_file = fopen("./users.csv", "w");
+  fprintf(users_file, "user,lessons,keystrokes,misses,avg_time,p90_time,"
+                      "recent_err_rate,worst_key\n");
+  for (long i = 0; i < paths->n; ++i) {
+    const UserSummary *u = &summaries[i];
+    write_csv_quoted(users_file, paths->paths[i], strlen(paths->paths[i]));
+    fprintf(users_file, ",%lu,%ld,%ld,%f,%f,%f,%i\n",
+            (unsigned long)u->lessons, u->keystrokes, u->misses, u->avg_time,
+            u->p90_time, u->recent_err_rate, u->worst_key);
+  }
+  fclose(users_file);
+}
+
+/**
+ * @brief merge the stats files of many users on all cores
+ *
+ * Every worker reduces whole files into a private aggregate, which are
+ * merged at the end, so the work scales with the number of files. Writes the
+ * merged stats like a single user and one summary row per file to users.csv.
+ */
+static void dump_merged(const PathList *paths) {
+  long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+  if (n_threads > paths->n) {
+    n_threads = paths->n;
+  }
+
+  UserSummary *summaries =
+      calloc((unsigned long)paths->n, sizeof(UserSummary));
+  Worker *workers = calloc((unsigned long)n_threads, sizeof(Worker));
+  pthread_t *threads = calloc((unsigned long)n_threads, sizeof(pthread_t));
+  atomic_long next = 0;
+
+  for (long t = 0; t < n_threads; ++t) {
+    workers[t] = (Worker){
+        .paths = paths,
+        .summaries = summaries,
+        .next = &next,
+        .confusions = calloc(1, sizeof(ConfMatrix)),
+        .mds = calloc(1, sizeof(MonoGramDataSummary)),
+        .bt = BT_new(),
+    };
+    if (pthread_create(&threads[t], NULL, &aggregate, &workers[t]) != 0) {
+      exit_err_dconv("Error starting worker for", paths->paths[0]);
+    }
+  }
+
+  Worker *total = &workers[0];
+  pthread_join(threads[0], NULL);
+  for (long t = 1; t < n_threads; ++t) {
+    pthread_join(threads[t], NULL);
+    // partial aggregates are already at tick 0
+    merge_conf_matrix(total->confusions, workers[t].confusions, 0);
+    MDS_merge(total->mds, workers[t].mds, 0);
+    BT_merge(&total->bt, &workers[t].bt, 0);
+  }
+
+  dump_stats_csv(total->mds, total->confusions, &total->bt, 0);
+  write_users_csv(paths, summaries);
+  printf("Merged %ld stats files on %ld threads\n", paths->n, n_threads);
+
+  for (long t = 0; t < n_threads; ++t) {
+    free(workers[t].confusions);
+    free(workers[t].mds);
+    BT_free(&workers[t].bt);
+  }
+  free(threads);
+  free(workers);
+  free(summaries);
+}
+
+int main(int argc, char **argv) {
+  init_crc_table();
+
+  if (argc > 1) {
+    PathList paths = {0};
+    for (int i = 1; i < argc; ++i) {
+      PL_collect(&paths, argv[i]);
+    }
+    if (paths.n == 0) {
+      fprintf(stderr, "No stats files found\nExiting...\n");
       exit(EXIT_FAILURE);
     }
-  } else {
-    fseek(data_file, 0, SEEK_SET);
-    fread(&confusions, sizeof(ConfMatrix), 1, data_file);
-    fread(&mds, sizeof(MonoGramDataSummary), 1, data_file);
-    fread(&bt, sizeof(BigramTable), 1, data_file);
-    fclose(data_file);
+    qsort(paths.paths, (unsigned long)paths.n, sizeof(char *), &cmp_paths);
+    dump_merged(&paths);
+    PL_free(&paths);
+    deinit_crc_table();
+    return 0;
   }
 
-  dump_stats_csv(&mds, &confusions, &bt);
+  // read-only, a running typtr may be appending to the journal
+  StatsStore store;
+  SS_open(&store, false);
+
+  NGramStats ng = NG_open(false);
+
+  dump_stats_csv(store.mds, store.confusions, store.bt, (uint32_t)store.seq);
+  NG_dump_csv(&ng);
+  LH_dump_csv();
+
+  NG_close(&ng);
+  SS_close(&store);
+  deinit_crc_table();
 }
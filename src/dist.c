@@ -0,0 +1,61 @@
+#include "dist.h"
+
+#include "math.h"
+
+int DIST_bucket(double x) {
+  if (!(x > DIST_MIN_MS)) {
+    return 0;
+  }
+  const double b = floor(log2(x / DIST_MIN_MS) * DIST_BUCKETS_PER_OCTAVE);
+  return b >= DIST_BUCKETS - 1 ? DIST_BUCKETS - 1 : (int)b;
+}
+
+void DIST_add(Dist *d, long n, double x) {
+  const double delta = x - d->mean;
+  d->mean += delta / (double)n;
+  d->m2 += delta * (x - d->mean);
+  ++d->hist[DIST_bucket(x)];
+}
+
+void DIST_merge(Dist *d, long n, const Dist *other, long n_other) {
+  if (n_other == 0) {
+    return;
+  }
+  const double total = (double)(n + n_other);
+  const double delta = other->mean - d->mean;
+  d->mean += delta * (double)n_other / total;
+  d->m2 += other->m2 + delta * delta * (double)n * (double)n_other / total;
+  for (int b = 0; b < DIST_BUCKETS; ++b) {
+    d->hist[b] += other->hist[b];
+  }
+}
+
+double DIST_variance(const Dist *d, long n) {
+  return n > 1 ? d->m2 / (double)(n - 1) : 0.0;
+}
+
+double DIST_quantile(const Dist *d, double q) {
+  uint64_t total = 0;
+  for (int b = 0; b < DIST_BUCKETS; ++b) {
+    total += d->hist[b];
+  }
+  if (total == 0) {
+    return d->mean;
+  }
+
+  const double target = q * (double)total;
+  double before = 0.0;
+  for (int b = 0; b < DIST_BUCKETS; ++b) {
+    const double count = d->hist[b];
+    if (count > 0.0 && before + count >= target) {
+      const double frac = (target - before) / count;
+      if (b == 0) {
+        // the first bucket starts at 0, not at DIST_MIN_MS
+        return frac * DIST_MIN_MS * exp2(1.0 / DIST_BUCKETS_PER_OCTAVE);
+      }
+      return DIST_MIN_MS * exp2((b + frac) / DIST_BUCKETS_PER_OCTAVE);
+    }
+    before += count;
+  }
+  return DIST_MIN_MS * exp2((double)DIST_BUCKETS / DIST_BUCKETS_PER_OCTAVE);
+}
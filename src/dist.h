@@ -0,0 +1,60 @@
+#ifndef DIST_H
+#define DIST_H
+
+#include "stdint.h"
+
+// latency histogram buckets, DIST_BUCKETS_PER_OCTAVE per doubling from
+// DIST_MIN_MS, the last bucket also holds everything slower
+#define DIST_BUCKETS 32
+#define DIST_BUCKETS_PER_OCTAVE 4
+#define DIST_MIN_MS 8.0
+
+/**
+ * Streaming distribution of a latency with bounded size.
+ *
+ * Mean and variance are kept with Welford's method, which does not lose
+ * precision over long histories. Quantiles come from a log-bucket histogram,
+ * so their relative error is bounded by the bucket width (~19%). The number
+ * of samples is kept by the owner of the Dist.
+ */
+typedef struct {
+  double mean;
+  double m2; //< sum of squared differences from the mean
+  uint32_t hist[DIST_BUCKETS];
+} Dist;
+
+/** histogram bucket of latency x in ms */
+int DIST_bucket(double x);
+
+/**
+ * @brief add a sample
+ *
+ * @param n number of samples including x
+ * @param x latency in ms
+ */
+void DIST_add(Dist *d, long n, double x);
+
+/**
+ * @brief add all samples of other to d
+ *
+ * Uses the pairwise update of Chan et al., so the result is the same as
+ * adding the samples one by one.
+ *
+ * @param n number of samples in d before merging
+ * @param n_other number of samples in other
+ */
+void DIST_merge(Dist *d, long n, const Dist *other, long n_other);
+
+/** sample variance, 0 for less than two samples */
+double DIST_variance(const Dist *d, long n);
+
+/**
+ * @brief estimate the q quantile, 0 <= q <= 1
+ *
+ * Interpolates log-linearly inside the bucket. Returns the mean if the
+ * histogram is empty, e.g. for stats converted from before histograms
+ * existed.
+ */
+double DIST_quantile(const Dist *d, double q);
+
+#endif // DIST_H
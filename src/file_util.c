@@ -30,3 +30,15 @@ long get_fsize_or_panic(FILE *f, const char *fname) {
 
   return size;
 }
+
+void write_csv_quoted(FILE *f, const char *s, size_t len) {
+  fputc('"', f);
+  for (size_t i = 0; i < len; ++i) {
+    // quotes are doubled inside quoted fields
+    if (s[i] == '"') {
+      fputc('"', f);
+    }
+    fputc(s[i], f);
+  }
+  fputc('"', f);
+}
@@ -6,4 +6,7 @@
 void exit_err_file(const char *msg, const char *fname);
 
 long get_fsize_or_panic(FILE *f, const char *fname);
+
+/** @brief write the len chars of s as a quoted CSV field */
+void write_csv_quoted(FILE *f, const char *s, size_t len);
 #endif
@@ -0,0 +1,404 @@
+#include "history.h"
+
+#include "errno.h"
+#include "fcntl.h"
+#include "math.h"
+#include "stats.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "time.h"
+#include "unistd.h"
+
+// longest varint of a 64 bit value
+#define VARINT_MAX 10
+
+static void exit_err_history(const char *msg) {
+  fprintf(stderr, "%s '%s': %s\nExiting...\n", msg, HISTORY_NAME,
+          strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+// false if the varint runs past end
+static inline bool get_varint(const uint8_t **p, const uint8_t *end,
+                              uint64_t *v) {
+  uint64_t ret = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    const uint8_t b = *(*p)++;
+    ret |= (uint64_t)(b & 0x7f) << shift;
+    if (b < 0x80) {
+      *v = ret;
+      return true;
+    }
+  }
+  return false;
+}
+
+// small magnitudes of either sign get short varints
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void LH_init_header(LHHeader *header) {
+  memcpy(header->magic, LH_MAGIC, sizeof(header->magic));
+  header->version = LH_VERSION;
+  header->byte_order = LH_BYTE_ORDER;
+}
+
+bool LH_reader_open(HistoryReader *r) {
+  *r = (HistoryReader){0};
+
+  errno = 0;
+  const int fd = open(HISTORY_NAME, O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      exit_err_history("Error opening history file");
+    }
+    errno = 0;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    exit_err_history("Error reading history file");
+  }
+  // a crash while creating the file leaves less than a header
+  if ((size_t)st.st_size < sizeof(LHHeader)) {
+    close(fd);
+    return false;
+  }
+
+  r->size = (size_t)st.st_size;
+  r->data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (r->data == MAP_FAILED) {
+    exit_err_history("Error mapping history file");
+  }
+  // read front to back exactly once
+  madvise((void *)r->data, r->size, MADV_SEQUENTIAL);
+
+  LHHeader expected = {0};
+  LH_init_header(&expected);
+  if (memcmp(r->data, &expected, sizeof(expected)) != 0) {
+    fprintf(stderr,
+            "History file '%s' has an unsupported version or layout\n"
+            "Exiting...\n",
+            HISTORY_NAME);
+    exit(EXIT_FAILURE);
+  }
+  r->pos = sizeof(LHHeader);
+  return true;
+}
+
+/**
+ * @brief step over the next intact record
+ *
+ * A crash while appending only tears the last record, which runs past the
+ * end of the file or ends exactly there. A corrupted record before it is
+ * skipped with a warning, the lessons after it stay readable.
+ *
+ * @return false at the end of the history or at a torn last record
+ */
+static bool next_record(HistoryReader *r, const uint8_t **columns,
+                        uint32_t *size) {
+  for (;;) {
+    LHRecordHeader rec;
+    const size_t left = r->size - r->pos;
+    if (left < sizeof(rec)) {
+      return false;
+    }
+    memcpy(&rec, r->data + r->pos, sizeof(rec));
+    const uint8_t *start = r->data + r->pos + sizeof(rec);
+    if (left - sizeof(rec) < rec.size) {
+      return false;
+    }
+    const bool last = left - sizeof(rec) == rec.size;
+    if (crc32((const char *)start, rec.size) == rec.crc) {
+      r->pos += sizeof(rec) + rec.size;
+      *columns = start;
+      *size = rec.size;
+      return true;
+    }
+    if (last) {
+      return false;
+    }
+    fprintf(stderr,
+            "Skipping a corrupted record at offset %zu of history file "
+            "'%s'\n",
+            r->pos, HISTORY_NAME);
+    r->pos += sizeof(rec) + rec.size;
+  }
+}
+
+static void reserve(HistoryReader *r, int n) {
+  if (n <= r->cap) {
+    return;
+  }
+  r->cap = n;
+  const size_t cap = (size_t)n;
+  r->chars = realloc(r->chars, cap);
+  r->typedchars = realloc(r->typedchars, cap);
+  r->time_to_type = realloc(r->time_to_type, cap * sizeof(double));
+  r->errors = realloc(r->errors, cap * sizeof(bool));
+}
+
+bool LH_next(HistoryReader *r, LessonRecord *rec) {
+  const uint8_t *p;
+  uint32_t size;
+  if (!next_record(r, &p, &size)) {
+    return false;
+  }
+  const uint8_t *end = p + size;
+
+  uint64_t seq, finished, n_chars;
+  if (!get_varint(&p, end, &seq) || !get_varint(&p, end, &finished) ||
+      !get_varint(&p, end, &n_chars) || n_chars > (uint64_t)(end - p)) {
+    return false;
+  }
+  const int n = (int)n_chars;
+  reserve(r, n);
+
+  memcpy(r->chars, p, n_chars);
+  memcpy(r->typedchars, p, n_chars);
+  p += n_chars;
+
+  uint64_t count, delta;
+  if (!get_varint(&p, end, &count)) {
+    return false;
+  }
+  uint64_t pos = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (!get_varint(&p, end, &delta) || p == end ||
+        (pos += delta) >= n_chars) {
+      return false;
+    }
+    r->typedchars[pos] = (char)*p++;
+  }
+
+  memset(r->errors, 0x0, n_chars * sizeof(bool));
+  if (!get_varint(&p, end, &count)) {
+    return false;
+  }
+  pos = 0;
+  for (uint64_t i = 0; i < count; ++i) {
+    if (!get_varint(&p, end, &delta) || (pos += delta) >= n_chars) {
+      return false;
+    }
+    r->errors[pos] = true;
+  }
+
+  int64_t us = 0;
+  for (int i = 0; i < n; ++i) {
+    if (!get_varint(&p, end, &delta)) {
+      return false;
+    }
+    us += unzigzag(delta);
+    r->time_to_type[i] = (double)us / 1000.0;
+  }
+
+  // every keystroke
+  uint64_t n_events;
+  if (!get_varint(&p, end, &n_events) || n_events > (uint64_t)(end - p)) {
+    return false;
+  }
+  if ((int)n_events > r->events_cap) {
+    r->events_cap = (int)n_events;
+    r->events =
+        realloc(r->events, (size_t)r->events_cap * sizeof(TextEvent));
+  }
+  pos = 0;
+  uint64_t event_us = 0;
+  for (uint64_t i = 0; i < n_events; ++i) {
+    if (!get_varint(&p, end, &delta) || p == end ||
+        (pos += delta) >= n_chars) {
+      return false;
+    }
+    const char c = (char)*p++;
+    if (!get_varint(&p, end, &delta)) {
+      return false;
+    }
+    event_us += delta;
+    r->events[i] = (TextEvent){
+        .time_ns = event_us * 1000, .pos = (int)pos, .c = c};
+  }
+
+  *rec = (LessonRecord){
+      .seq = seq,
+      .time = (int64_t)finished,
+      .n_chars = n,
+      .chars = r->chars,
+      .typedchars = r->typedchars,
+      .time_to_type = r->time_to_type,
+      .errors = r->errors,
+      .events = r->events,
+      .n_events = (int)n_events,
+  };
+  return true;
+}
+
+void LH_reader_close(HistoryReader *r) {
+  if (r->data) {
+    munmap((void *)r->data, r->size);
+  }
+  free(r->chars);
+  free(r->typedchars);
+  free(r->time_to_type);
+  free(r->errors);
+  free(r->events);
+  *r = (HistoryReader){0};
+}
+
+LessonHistory LH_open(void) {
+  // drop a torn last record, so new records stay readable. Corrupted ones
+  // before it are kept.
+  HistoryReader r;
+  const bool exists = LH_reader_open(&r);
+  const uint8_t *columns;
+  uint32_t size;
+  while (exists && next_record(&r, &columns, &size)) {
+  }
+  const off_t end = exists ? (off_t)r.pos : 0;
+  LH_reader_close(&r);
+  if (truncate(HISTORY_NAME, end) != 0 && errno != ENOENT) {
+    exit_err_history("Error truncating history file");
+  }
+
+  errno = 0;
+  LessonHistory h = {.f = fopen(HISTORY_NAME, "a")};
+  if (h.f == NULL) {
+    exit_err_history("Error opening history file");
+  }
+  if (!exists) {
+    LHHeader header = {0};
+    LH_init_header(&header);
+    if (fwrite(&header, sizeof(header), 1, h.f) != 1 || fflush(h.f) != 0) {
+      exit_err_history("Error writing history file");
+    }
+  }
+  return h;
+}
+
+void LH_append(LessonHistory *h, const Text *t, uint64_t seq) {
+  const size_t n = (size_t)t->n_chars;
+  const size_t n_events = (size_t)t->n_events;
+  // per key at most a char, a typo, an error and a time, per keystroke a
+  // position, a char and a time
+  uint8_t *buf = malloc(6 * VARINT_MAX + n * (3 * VARINT_MAX + 2) +
+                        n_events * (2 * VARINT_MAX + 1));
+  uint8_t *p = buf;
+
+  p = put_varint(p, seq);
+  p = put_varint(p, (uint64_t)time(NULL));
+  p = put_varint(p, n);
+
+  memcpy(p, t->chars, n);
+  p += n;
+
+  uint64_t count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += t->typedchars[i] != t->chars[i];
+  }
+  p = put_varint(p, count);
+  size_t last = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (t->typedchars[i] != t->chars[i]) {
+      p = put_varint(p, i - last);
+      *p++ = (uint8_t)t->typedchars[i];
+      last = i;
+    }
+  }
+
+  count = 0;
+  for (size_t i = 0; i < n; ++i) {
+    count += t->errors[i];
+  }
+  p = put_varint(p, count);
+  last = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (t->errors[i]) {
+      p = put_varint(p, i - last);
+      last = i;
+    }
+  }
+
+  int64_t prev = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const int64_t us = t->time_to_type[i] > 0.0
+                           ? (int64_t)llround(t->time_to_type[i] * 1000.0)
+                           : 0;
+    p = put_varint(p, zigzag(us - prev));
+    prev = us;
+  }
+
+  p = put_varint(p, n_events);
+  int last_pos = 0;
+  uint64_t last_us = n_events > 0 ? t->events[0].time_ns / 1000 : 0;
+  for (size_t i = 0; i < n_events; ++i) {
+    const TextEvent *e = &t->events[i];
+    const uint64_t us = e->time_ns / 1000;
+    p = put_varint(p, (uint64_t)(e->pos - last_pos));
+    *p++ = (uint8_t)e->c;
+    p = put_varint(p, us - last_us);
+    last_pos = e->pos;
+    last_us = us;
+  }
+
+  const LHRecordHeader rec = {
+      .size = (uint32_t)(p - buf),
+      .crc = crc32((const char *)buf, p - buf),
+  };
+  const bool ok = fwrite(&rec, sizeof(rec), 1, h->f) == 1 &&
+                  fwrite(buf, 1, rec.size, h->f) == rec.size &&
+                  fflush(h->f) == 0;
+  free(buf);
+  if (!ok) {
+    exit_err_history("Error appending to history file");
+  }
+}
+
+void LH_close(LessonHistory *h) {
+  if (h->f) {
+    fclose(h->f);
+  }
+  *h = (LessonHistory){0};
+}
+
+void LH_dump_csv(void) {
+  FILE *ks_file = fopen("./keystrokes.csv", "w");
+  fprintf(ks_file, "lesson,time,index,char,typed,time_ms,error\n");
+  FILE *ev_file = fopen("./events.csv", "w");
+  fprintf(ev_file, "lesson,index,char,typed,time_ms\n");
+
+  HistoryReader r;
+  if (LH_reader_open(&r)) {
+    LessonRecord rec;
+    while (LH_next(&r, &rec)) {
+      for (int i = 0; i < rec.n_chars; ++i) {
+        fprintf(ks_file, "%lu,%ld,%i,%i,%i,%f,%i\n", (unsigned long)rec.seq,
+                (long)rec.time, i, rec.chars[i], rec.typedchars[i],
+                rec.time_to_type[i], rec.errors[i]);
+      }
+      for (int i = 0; i < rec.n_events; ++i) {
+        const TextEvent *e = &rec.events[i];
+        fprintf(ev_file, "%lu,%i,%i,%i,%f\n", (unsigned long)rec.seq, e->pos,
+                rec.chars[e->pos], e->c, (double)e->time_ns / 1000000.0);
+      }
+    }
+  }
+  LH_reader_close(&r);
+  fclose(ev_file);
+  fclose(ks_file);
+}
@@ -0,0 +1,122 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "stdio.h"
+#include "text.h"
+
+#define HISTORY_NAME "typtr_history.dat"
+#define LH_MAGIC "TYPH"
+#define LH_VERSION 1
+#define LH_BYTE_ORDER 0x01020304u
+
+/**
+ * On-disk header of the history file. It is followed by one record per
+ * lesson, each an LHRecordHeader and size bytes of columns.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t pad;
+} LHHeader;
+
+typedef struct {
+  uint32_t size; //< bytes of columns after the record header
+  uint32_t crc;  //< crc32 of the columns
+} LHRecordHeader;
+
+/**
+ * Appends every finished lesson to the history file.
+ *
+ * Records are columnar and varint-packed, as one lesson is only a few hundred
+ * keystrokes and most of them are typed correctly:
+ *  - seq, unix time and n_chars
+ *  - target chars, one byte each
+ *  - typed chars that differ from the target, as position delta and char
+ *  - positions with an error flag, as deltas
+ *  - time to type in microseconds, zigzag delta to the previous key
+ *  - every keystroke, typos included, as position delta, char and
+ *    microseconds since the previous keystroke
+ *
+ * That is about four bytes per keystroke at typing speed, so years of
+ * lessons stay in the megabytes. A torn last record from a crash is dropped
+ * when the file is opened again, corrupted records before it are skipped
+ * with a warning.
+ */
+typedef struct {
+  FILE *f;
+} LessonHistory;
+
+/** one decoded lesson, the arrays belong to the reader */
+typedef struct {
+  uint64_t seq; //< lesson sequence number of the stats store
+  int64_t time; //< unix time the lesson was finished
+  int n_chars;
+  const char *chars;
+  const char *typedchars;
+  const double *time_to_type;
+  const bool *errors;
+  const TextEvent *events; //< times relative to the first keystroke
+  int n_events;
+} LessonRecord;
+
+/**
+ * Sequential reader over the mapped history file.
+ */
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+  size_t pos;
+
+  // decode buffers, grown to the longest lesson
+  char *chars;
+  char *typedchars;
+  double *time_to_type;
+  bool *errors;
+  int cap;
+  TextEvent *events;
+  int events_cap;
+} HistoryReader;
+
+/**
+ * @brief open the history file for appending, creating it if needed
+ */
+LessonHistory LH_open(void);
+
+/**
+ * @brief append the finished lesson t
+ *
+ * @param seq sequence number of the lesson in the stats store
+ */
+void LH_append(LessonHistory *h, const Text *t, uint64_t seq);
+
+void LH_close(LessonHistory *h);
+
+/**
+ * @brief map the history file for reading
+ *
+ * @return false if there is no history yet
+ */
+bool LH_reader_open(HistoryReader *r);
+
+/**
+ * @brief decode the next lesson into rec
+ *
+ * The arrays of rec stay valid until the next call.
+ *
+ * @return false at the end of the history or at a torn last record
+ */
+bool LH_next(HistoryReader *r, LessonRecord *rec);
+
+void LH_reader_close(HistoryReader *r);
+
+/**
+ * @brief write every char of the history to ./keystrokes.csv and every
+ *        keystroke, typos included, to ./events.csv
+ */
+void LH_dump_csv(void);
+
+#endif // HISTORY_H
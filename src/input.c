@@ -0,0 +1,169 @@
+#include "input.h"
+
+#include "errno.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "pthread.h"
+#include "semaphore.h"
+#include "stdatomic.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "thread_util.h"
+#include "time.h"
+#include "unistd.h"
+
+// bytes of a single read, pasted text arrives in bursts
+#define IN_BUF_SIZE 64
+// keys the UI can fall behind, a power of two
+#define IN_RING_SIZE 4096
+// producer and consumer indices on their own cache lines
+#define CACHE_LINE 64
+
+static KeyEvent ring[IN_RING_SIZE];
+// next slot the capture thread writes, only it stores
+static _Alignas(CACHE_LINE) atomic_size_t ring_head = 0;
+// next slot the UI reads, only it stores
+static _Alignas(CACHE_LINE) atomic_size_t ring_tail = 0;
+// one post per pushed key and one at the end of the input
+static sem_t ring_ready;
+
+static pthread_t capture;
+static bool capturing = false;
+// written to stop the capture thread
+static int stop_pipe[2] = {-1, -1};
+static atomic_bool in_closed = false;
+static int in_flags = -1;
+
+uint64_t IN_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// false if the capture thread is asked to stop while the ring is full
+static bool push(KeyEvent ev) {
+  const size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+  while (head - atomic_load_explicit(&ring_tail, memory_order_acquire) ==
+         IN_RING_SIZE) {
+    // the UI is stalled, wait for it rather than losing keys
+    struct pollfd pfd = {.fd = stop_pipe[0], .events = POLLIN};
+    if (poll(&pfd, 1, 1) > 0) {
+      return false;
+    }
+  }
+  ring[head % IN_RING_SIZE] = ev;
+  atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+  sem_post(&ring_ready);
+  return true;
+}
+
+static void *capture_keys(void *arg) {
+  (void)arg;
+  char buf[IN_BUF_SIZE];
+  for (;;) {
+    struct pollfd pfds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                             {.fd = stop_pipe[0], .events = POLLIN}};
+    if (poll(pfds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "Error waiting for input: %s\nExiting...\n",
+              strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    if (pfds[1].revents) {
+      return NULL;
+    }
+
+    const ssize_t n = read(STDIN_FILENO, buf, IN_BUF_SIZE);
+    const uint64_t stamp = IN_now();
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+        continue;
+      }
+      fprintf(stderr, "Error reading input: %s\nExiting...\n",
+              strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    if (n == 0) {
+      atomic_store(&in_closed, true);
+      sem_post(&ring_ready);
+      return NULL;
+    }
+    for (ssize_t i = 0; i < n; ++i) {
+      if (!push((KeyEvent){.time_ns = stamp, .c = buf[i]})) {
+        return NULL;
+      }
+    }
+  }
+}
+
+void IN_init(void) {
+  in_flags = fcntl(STDIN_FILENO, F_GETFL);
+  if (in_flags < 0 ||
+      fcntl(STDIN_FILENO, F_SETFL, in_flags | O_NONBLOCK) != 0 ||
+      pipe(stop_pipe) != 0 || sem_init(&ring_ready, 0, 0) != 0) {
+    fprintf(stderr, "Error configuring input: %s\nExiting...\n",
+            strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  const int err = start_worker(&capture, &capture_keys, NULL);
+  if (err != 0) {
+    fprintf(stderr, "Error starting input thread: %s\nExiting...\n",
+            strerror(err));
+    exit(EXIT_FAILURE);
+  }
+  capturing = true;
+  // also stop it and restore the flags when exiting on an error
+  atexit(&IN_deinit);
+}
+
+void IN_deinit(void) {
+  if (capturing) {
+    capturing = false;
+    // an error in the capture thread exits from it
+    if (!pthread_equal(pthread_self(), capture)) {
+      if (write(stop_pipe[1], "", 1) == 1) {
+        pthread_join(capture, NULL);
+      }
+    }
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+    stop_pipe[0] = stop_pipe[1] = -1;
+  }
+  // the flags belong to the terminal, the shell reads it afterwards
+  if (in_flags >= 0) {
+    fcntl(STDIN_FILENO, F_SETFL, in_flags);
+    in_flags = -1;
+  }
+}
+
+bool IN_closed(void) { return atomic_load(&in_closed); }
+
+bool IN_pending(void) {
+  return atomic_load_explicit(&ring_tail, memory_order_relaxed) !=
+         atomic_load_explicit(&ring_head, memory_order_acquire);
+}
+
+bool IN_next(KeyEvent *ev) {
+  // the post at the end of the input is taken once, don't wait again
+  if (IN_closed() && !IN_pending()) {
+    return false;
+  }
+  while (sem_wait(&ring_ready) != 0) {
+    if (errno == EINTR) {
+      return false;
+    }
+  }
+
+  const size_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&ring_head, memory_order_acquire)) {
+    // every key before the end was posted first
+    return false;
+  }
+  *ev = ring[tail % IN_RING_SIZE];
+  atomic_store_explicit(&ring_tail, tail + 1, memory_order_release);
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "stdbool.h"
+#include "stdint.h"
+
+/** a byte read from the terminal */
+typedef struct {
+  uint64_t time_ns; //< CLOCK_MONOTONIC when it was read
+  char c;
+} KeyEvent;
+
+/** @brief CLOCK_MONOTONIC in ns, not affected by changes of the wall clock */
+uint64_t IN_now(void);
+
+/**
+ * @brief start capturing keys from stdin on a dedicated thread
+ *
+ * The thread reads stdin without stdio, stamps the keys and queues them in a
+ * lock-free single producer, single consumer ring. Keys are stamped when
+ * they arrive, however long the UI takes to draw the previous one. Signals
+ * are left to the calling thread. IN_deinit stops the thread and restores
+ * the file status flags, it also runs at exit.
+ */
+void IN_init(void);
+
+void IN_deinit(void);
+
+/**
+ * @brief take the next byte from stdin, waiting for it if none is queued
+ *
+ * Bytes are stamped as soon as the read returns, all bytes of one read
+ * arrived together and get the same stamp.
+ *
+ * @return false if a signal interrupted the wait or the input was closed
+ */
+bool IN_next(KeyEvent *ev);
+
+/** @brief true if IN_next returns without waiting, to draw once per burst */
+bool IN_pending(void);
+
+/** @brief true once stdin reached its end, nothing will be typed anymore */
+bool IN_closed(void);
+
+#endif // INPUT_H
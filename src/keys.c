@@ -2,6 +2,36 @@
 
 int char_idx(char c) { return c - KC_SPC; }
 
+bool is_key(char c) { return c >= KC_SPC && c < KC_DEL; }
+
+void CM_set(CharMask *mask, char c) {
+  if (!is_key(c)) {
+    return;
+  }
+  const int idx = char_idx(c);
+  if (idx < 64) {
+    mask->lo |= 1ull << idx;
+  } else {
+    mask->hi |= 1ull << (idx - 64);
+  }
+}
+
+CharMask CM_of_chars(const char *chars, int len) {
+  CharMask ret = {0};
+  for (int i = 0; i < len; ++i) {
+    CM_set(&ret, chars[i]);
+  }
+  return ret;
+}
+
+bool CM_intersects(CharMask a, CharMask b) {
+  return ((a.lo & b.lo) | (a.hi & b.hi)) != 0;
+}
+
+bool CM_contains(CharMask a, CharMask b) {
+  return ((a.lo & b.lo) == b.lo) & ((a.hi & b.hi) == b.hi);
+}
+
 const char keys[N_CHARS] = " !\"#$%&'()*+,-./"
                            "0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
                            "abcdefghijklmnopqrstuvwxyz{|}~";
@@ -1,9 +1,38 @@
 #ifndef KEYS_H
 #define KEYS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #define N_CHARS (128 - 32 - 1)
 int char_idx(char c);
 
+/** true if c is one of the N_CHARS printable keys */
+bool is_key(char c);
+
+/** Set of keys, bit char_idx(c) is set if c is contained */
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+} CharMask;
+
+/**
+ * @brief Build CharMask of all keys in chars
+ *
+ * @param chars character array
+ * @param len length of chars
+ */
+CharMask CM_of_chars(const char *chars, int len);
+
+/** Add key c to mask */
+void CM_set(CharMask *mask, char c);
+
+/** true if a and b have any key in common */
+bool CM_intersects(CharMask a, CharMask b);
+
+/** true if every key of b is in a */
+bool CM_contains(CharMask a, CharMask b);
+
 typedef enum {
   KC_NUL = 0, //< Null Character
   KC_SOH, //< Start of Header
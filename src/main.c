@@ -4,8 +4,8 @@
 #include "signal.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "string.h"
 #include "sys/ioctl.h"
-#include "sys/time.h"
 #include "unistd.h"
 #include <stdbool.h>
 #include <stdint.h>
@@ -13,179 +13,184 @@
 #define SL_IMPLEMENTATION
 #include "sl.h"
 
+#include "arena.h"
+#include "corpus.h"
+#include "history.h"
+#include "input.h"
 #include "keys.h"
+#include "ngram.h"
+#include "rank.h"
+#include "sampler.h"
+#include "screen.h"
 #include "stats.h"
+#include "store.h"
+#include "stream.h"
 #include "term_handler.h"
 #include "text.h"
+#include "twl.h"
+#include "wl_cache.h"
 #include "wordlist.h"
 
 #define LINE_SIZE_WORDS 20
+// stream lines typed as one lesson in endless mode, so the stats decay by the
+// same number of words in both modes
+#define ENDLESS_LESSON_LINES (LINE_SIZE_WORDS / STREAM_LINE_WORDS)
+// upcoming lines shown below the current ones in endless mode
+#define PREVIEW_LINES 3
 #define POST_BUF_SZ 256
-
-#define RED "\033[31m"
-#define GRN "\033[34m"
-#define RST "\033[0m"
-
-typedef struct {
-  char c;
-  float time;
-  float err_rate;
-} ChrInfo;
-
-static int CI_gt(const void *a, const void *b) {
-  ChrInfo *ca = (ChrInfo *)a;
-  ChrInfo *cb = (ChrInfo *)b;
-
-  if (isnanf(ca->err_rate) && !isnanf(cb->err_rate)) {
-    return INT32_MAX;
-  }
-  if (isnanf(cb->err_rate) && !isnanf(ca->err_rate)) {
-    return INT32_MIN;
-  }
-  if (isnanf(cb->err_rate) && isnanf(ca->err_rate)) {
-    return 0;
-  }
-  if (ca->err_rate == cb->err_rate) {
-    return ca->time < cb->time;
-  }
-  return ca->err_rate < cb->err_rate;
-}
-
-static int CI_lt(const void *a, const void *b) {
-  ChrInfo *ca = (ChrInfo *)a;
-  ChrInfo *cb = (ChrInfo *)b;
-
-  if (isnanf(ca->err_rate) && !isnanf(cb->err_rate)) {
-    return INT32_MAX;
-  }
-  if (isnanf(cb->err_rate) && !isnanf(ca->err_rate)) {
-    return INT32_MIN;
-  }
-  if (isnanf(cb->err_rate) && isnanf(ca->err_rate)) {
-    return 0;
-  }
-
-  if (ca->err_rate == cb->err_rate) {
-    return ca->time > cb->time;
-  }
-
-  return ca->err_rate > cb->err_rate;
-}
-
-static ChrInfo *CI_list_new(const MonoGramDataSummary *mds) {
-  ChrInfo *chr_info = malloc(N_CHARS * sizeof(ChrInfo));
-  for (long i = 0; i < N_CHARS; ++i) {
-    chr_info[i].c = (char)(i + 32);
-    chr_info[i].time = mds->times[i];
-    chr_info[i].err_rate =
-        (float)mds->n_misses[i] / (float)mds->n_occurrences[i];
+#define LESSON_ARENA_SIZE (1ul << 20)
+
+// latency quantile that breaks ties in the weakness ranking
+#define RANK_QUANTILE 0.9
+
+// keys by weakness, never typed ones have a NaN error rate
+static RankEntry *CI_list_new(const MonoGramDataSummary *mds, Arena *arena) {
+  float rates[N_CHARS];
+  RANK_err_rates(mds->recent_misses, mds->recent_occurrences, rates, N_CHARS);
+
+  RankEntry *chr_info = arena_alloc(arena, N_CHARS * sizeof(RankEntry));
+  for (int i = 0; i < N_CHARS; ++i) {
+    chr_info[i] = (RankEntry){
+        .err_rate = rates[i],
+        .time = (float)DIST_quantile(&mds->latency[i], RANK_QUANTILE),
+        .id = (uint16_t)i,
+    };
   }
   return chr_info;
 }
 
-typedef struct {
-  char bigram[2];
-  float time;
-  float err_rate;
-} BigramInfo;
-
-static int BI_gt(const void *a, const void *b) {
-  BigramInfo *ba = (BigramInfo *)a;
-  BigramInfo *bb = (BigramInfo *)b;
-
-  if (isnanf(ba->err_rate) && !isnanf(bb->err_rate)) {
-    return INT32_MAX;
-  }
-  if (!isnanf(ba->err_rate) && isnanf(bb->err_rate)) {
-    return INT32_MIN;
-  }
-  if (isnanf(ba->err_rate) && isnanf(bb->err_rate)) {
-    return 0;
-  }
-
-  if (ba->err_rate == bb->err_rate) {
-    return ba->time < bb->time;
-  }
-  return ba->err_rate < bb->err_rate;
-}
-
-static int BI_lt(const void *a, const void *b) {
-  BigramInfo *ba = (BigramInfo *)a;
-  BigramInfo *bb = (BigramInfo *)b;
-
-  if (isnanf(ba->err_rate) && !isnanf(bb->err_rate)) {
-    return INT32_MAX;
-  }
-  if (!isnanf(ba->err_rate) && isnanf(bb->err_rate)) {
-    return INT32_MIN;
-  }
-  if (isnanf(ba->err_rate) && isnanf(bb->err_rate)) {
-    return 0;
-  }
-
-  if (ba->err_rate == bb->err_rate) {
-    return ba->time > bb->time;
-  }
-  return ba->err_rate > bb->err_rate;
-}
-
-static BigramInfo *BI_list_new(const BigramTable *bt) {
-  BigramInfo *bigram_info = malloc(N_CHARS * N_CHARS * sizeof(BigramInfo));
-  for (long first = 0; first < N_CHARS; ++first) {
-    for (long second = 0; second < N_CHARS; ++second) {
-      const long idx = first * N_CHARS + second;
-      bigram_info[idx].bigram[0] = keys[first];
-      bigram_info[idx].bigram[1] = keys[second];
-      bigram_info[idx].time = bt->avg_execution_time[first][second];
-      bigram_info[idx].err_rate = (float)bt->n_misses[first][second] /
-                                  (float)bt->n_occurrences[first][second];
+// only typed bigrams are listed, n is set to their number
+static RankEntry *BI_list_new(const BigramTable *bt, Arena *arena, long *n) {
+  RankEntry *bigram_info = arena_alloc(arena, bt->n * sizeof(RankEntry));
+  long idx = 0;
+  for (uint32_t i = 0; i < bt->cap; ++i) {
+    const BigramEntry *e = &bt->entries[i];
+    if (e->key == 0) {
+      continue;
     }
+    bigram_info[idx++] = (RankEntry){
+        .err_rate = RANK_err_rate(e->recent_misses, e->recent_occurrences),
+        .time = (float)DIST_quantile(&e->latency, RANK_QUANTILE),
+        .id = (uint16_t)(e->key - 1),
+    };
   }
+  *n = idx;
   return bigram_info;
 }
 
 #define WORST_N 10
 
-static WordList WL_update(const WordList *orig, const MonoGramDataSummary *mds,
-                          const BigramTable *bt) {
-  long *idcs = calloc((const unsigned long)orig->nwords, sizeof(long));
-  long n_words = 0;
-
-  ChrInfo *chr_info = CI_list_new(mds);
-  qsort(chr_info, N_CHARS, sizeof(ChrInfo), &CI_gt);
-
-  // BigramInfo *bigram_info = BI_list_new(bt);
+#define CHAR_ERR_SCALE 4.0
+#define BIGRAM_ERR_SCALE 4.0
+#define NGRAM_ERR_SCALE 4.0
+// share of the weight that follows word usage frequency, if known
+#define FREQ_MIX 0.5
+
+/**
+ * @brief weakness weight of every word in wl
+ *
+ * Every word has a base weight of 1, plus the scaled error rates of all keys
+ * and bigrams it contains. Key and bigram rates are the recent ones, so the
+ * last lessons count the most. Uses the per-word masks and the bigram
+ * postings, so no word is scanned for keys or bigrams. Words containing one
+ * of the most missed n-grams get its error rate on top, only the postings of
+ * its first bigram are searched for it. For lists with frequencies, the
+ * weight is then scaled towards the relative usage frequency of the word.
+ */
+static double *WL_weights(const WordList *wl, const MonoGramDataSummary *mds,
+                          const BigramTable *bt,
+                          const BigramPostings *postings,
+                          const NGramStats *ng, Arena *arena) {
+  double *weights =
+      arena_alloc(arena, (unsigned long)wl->nwords * sizeof(double));
+
+  float rates[N_CHARS];
+  RANK_err_rates(mds->recent_misses, mds->recent_occurrences, rates, N_CHARS);
+  double chr_err[N_CHARS];
+  for (int c = 0; c < N_CHARS; ++c) {
+    chr_err[c] = isnan(rates[c]) ? 0.0 : rates[c];
+  }
 
-  printf("1/4 of the words need to have a %c.\n", chr_info[0].c);
-  while (n_words < orig->nwords / 4) {
-    const long idx = rand() % orig->nwords;
+  for (long i = 0; i < wl->nwords; ++i) {
+    double w = 1.0;
+    uint64_t lo = wl->masks[i].lo;
+    uint64_t hi = wl->masks[i].hi;
+    for (; lo; lo &= lo - 1) {
+      w += CHAR_ERR_SCALE * chr_err[__builtin_ctzll(lo)];
+    }
+    for (; hi; hi &= hi - 1) {
+      w += CHAR_ERR_SCALE * chr_err[64 + __builtin_ctzll(hi)];
+    }
+    weights[i] = w;
+  }
 
-    if (SL_contains(orig->words[idx], &chr_info[0].c, 1)) {
-      idcs[n_words] = idx;
-      ++n_words;
+  for (uint32_t b = 0; b < bt->cap; ++b) {
+    const BigramEntry *e = &bt->entries[b];
+    if (e->key == 0 || e->recent_misses.value == 0.0f) {
       continue;
     }
+    const double err = RANK_err_rate(e->recent_misses, e->recent_occurrences);
+    long n = 0;
+    const uint32_t *words =
+        BP_words(postings, BE_first(e) * N_CHARS + BE_second(e), &n);
+    for (long i = 0; i < n; ++i) {
+      weights[words[i]] += BIGRAM_ERR_SCALE * err;
+    }
   }
 
-  for (long i = 0; i < orig->nwords && n_words < 3 * orig->nwords / 4; ++i) {
-    const long idx = rand() % orig->nwords;
-    for (long n = 0; n < WORST_N; ++n) {
-      if (SL_contains(orig->words[idx], &chr_info[n].c, 1)) {
-        idcs[n_words] = idx;
-        ++n_words;
+  for (int size = 0; size < NG_N_SIZES; ++size) {
+    for (uint32_t t = 0; t < ng->file->n_top[size]; ++t) {
+      const NGramTop *top = &ng->file->top[size][t];
+      const NGramCount c = NG_estimate(ng, top->gram, top->n);
+      if (c.occurrences == 0) {
         continue;
       }
+      const double err = (double)c.misses / (double)c.occurrences;
+      // only words with the first bigram of the n-gram can contain it
+      long n = 0;
+      const uint32_t *words = BP_words(
+          postings, char_idx(top->gram[0]) * N_CHARS + char_idx(top->gram[1]),
+          &n);
+      for (long i = 0; i < n; ++i) {
+        if (SL_contains(wl->words[words[i]], top->gram, top->n)) {
+          weights[words[i]] += NGRAM_ERR_SCALE * err;
+        }
+      }
     }
   }
 
-  for (; n_words < orig->nwords; ++n_words) {
-    idcs[n_words] = rand() % orig->nwords;
+  if (wl->freqs) {
+    double total = 0.0;
+    for (long i = 0; i < wl->nwords; ++i) {
+      total += wl->freqs[i];
+    }
+    if (total > 0.0) {
+      const double mean = total / (double)wl->nwords;
+      for (long i = 0; i < wl->nwords; ++i) {
+        weights[i] *=
+            FREQ_MIX * (double)wl->freqs[i] / mean + (1.0 - FREQ_MIX);
+      }
+    }
   }
 
-  WordList ret = WL_sample(orig, idcs, orig->nwords);
-  free(idcs);
-  free(chr_info);
-  return ret;
+  return weights;
+}
+
+static WordListView WL_update(const WordList *orig,
+                              const MonoGramDataSummary *mds,
+                              const BigramTable *bt,
+                              const BigramPostings *postings,
+                              const NGramStats *ng, Rng *rng, Arena *arena) {
+  long *idcs = arena_alloc(arena, (unsigned long)orig->nwords * sizeof(long));
+
+  double *weights = WL_weights(orig, mds, bt, postings, ng, arena);
+  AliasTable at = AT_build(weights, orig->nwords);
+  for (long i = 0; i < orig->nwords; ++i) {
+    idcs[i] = AT_draw(&at, rng);
+  }
+
+  AT_free(at);
+  return WLV_from_idcs(orig, idcs, orig->nwords);
 }
 
 static bool validate_persist(MonoGramDataSummary *mds, ConfMatrix *cm,
@@ -196,6 +201,29 @@ static bool validate_persist(MonoGramDataSummary *mds, ConfMatrix *cm,
          0;
 }
 
+// everything the words of a lesson are sampled from
+typedef struct {
+  const WordList *base;
+  ConfMatrix *confusions;
+  MonoGramDataSummary *mds;
+  BigramTable *bt;
+  const BigramPostings *postings;
+  const NGramStats *ng;
+} SampleCtx;
+
+// lessons only hold indices into base, the words are never copied
+static WordListView sample_words(void *ctx, Rng *rng, Arena *arena) {
+  SampleCtx *c = ctx;
+  if (validate_persist(c->mds, c->confusions, c->bt) && !c->base->freqs) {
+    return WLV_all(c->base);
+  }
+  return WL_update(c->base, c->mds, c->bt, c->postings, c->ng, rng, arena);
+}
+
+static WordList load_corpus(const char *fname) {
+  return get_corpus_wordlist(fname, CORPUS_DEFAULT_WORDS);
+}
+
 bool run = true;
 bool canceled = false;
 
@@ -204,52 +232,153 @@ static void sigint_handler() {
   canceled = true;
 }
 
-#if 0
-int main() {
-  // create ConfMatrix if no file is found, else load data from file
-  ConfMatrix *confusions = calloc(1, sizeof(ConfMatrix));
-  BigramTable *bt = calloc(1, sizeof(BigramTable));
-  MonoGramDataSummary *mds = calloc(1, sizeof(MonoGramDataSummary));
-
-  FILE *data_file = fopen(STORAGE_NAME, "r");
-  if (errno) {
-    if (errno == ENOENT) {
-      // file does not exist
-    } else {
-      fprintf(stderr, "Error opening storage file '%s': %s\nExiting...\n",
-              STORAGE_NAME, strerror(errno));
-      exit(EXIT_FAILURE);
+// the terminal changed its size, lay out and draw the lesson again
+volatile sig_atomic_t resized = false;
+
+static void sigwinch_handler() { resized = true; }
+
+// weakest and strongest keys and bigrams shown above a lesson
+typedef struct {
+  RankEntry worst_ci[WORST_N], best_ci[WORST_N];
+  RankEntry worst_bi[WORST_N], best_bi[WORST_N];
+  long n_worst_ci, n_best_ci, n_worst_bi, n_best_bi;
+} Rankings;
+
+static void draw_rankings(Screen *scr, const Rankings *r) {
+  SCR_goto(scr, (TermPos){5, 0});
+
+  SCR_printf(scr, "Worst %i chars:\n", WORST_N);
+  for (long i = 0; i < r->n_worst_ci; ++i) {
+    SCR_printf(scr, "'%c'  ", keys[r->worst_ci[i].id]);
+  }
+
+  SCR_printf(scr, "\nWorst %i bigrams:\n", WORST_N);
+  for (long i = 0; i < r->n_worst_bi; ++i) {
+    SCR_printf(scr, "'%c%c' ", keys[r->worst_bi[i].id / N_CHARS],
+               keys[r->worst_bi[i].id % N_CHARS]);
+  }
+
+  SCR_printf(scr, "\nBest %i chars:\n", WORST_N);
+  for (long i = 0; i < r->n_best_ci; ++i) {
+    SCR_printf(scr, "'%c'  ", keys[r->best_ci[i].id]);
+  }
+
+  SCR_printf(scr, "\nBest %i bigrams:\n", WORST_N);
+  for (long i = 0; i < r->n_best_bi; ++i) {
+    SCR_printf(scr, "'%c%c' ", keys[r->best_bi[i].id / N_CHARS],
+               keys[r->best_bi[i].id % N_CHARS]);
+  }
+}
+
+// everything drawn around the text of a lesson
+typedef struct {
+  Rankings ranks;
+  char *status; //< first line
+  const char *post_message;
+  StreamLine preview[PREVIEW_LINES]; //< upcoming lines in endless mode
+  int n_preview;
+} Frame;
+
+static void draw_preview(Screen *scr, const Text *text, const Frame *f) {
+  TermPos pos = text->t_line_starts[text->n_lines - 1];
+  pos.row -= text->top_line;
+  for (int l = 0; l < f->n_preview; ++l) {
+    const int *words = f->preview[l].words;
+    int len = STREAM_LINE_WORDS - 1;
+    for (int i = 0; i < STREAM_LINE_WORDS; ++i) {
+      len += text->w_list->words[words[i]].len;
+    }
+    // narrow terminals cut the line at the right
+    const int col = len < scr->cols ? (scr->cols - len) / 2 : 0;
+    SCR_goto(scr, (TermPos){.row = pos.row + 1 + l, .col = col});
+    for (int i = 0; i < STREAM_LINE_WORDS; ++i) {
+      SCR_printf(scr, i ? " " SL_FMT : SL_FMT,
+                 SL_FP(text->w_list->words[words[i]]));
     }
-  } else {
-    fseek(data_file, 0, SEEK_SET);
-    fread(confusions, sizeof(ConfMatrix), 1, data_file);
-    fread(mds, sizeof(MonoGramDataSummary), 1, data_file);
-    fread(bt, sizeof(BigramTable), 1, data_file);
-    fclose(data_file);
   }
+}
 
-  init_crc_table();
-  srand(crc32((char *)confusions, sizeof(ConfMatrix)));
+// status, message and rankings, returns the rows they take at the top
+static int draw_header(Screen *scr, const Frame *f) {
+  SCR_goto(scr, (TermPos){0});
+  SCR_printf(scr, "%s\n", f->status);
+  SCR_printf(scr, "%s\n", f->post_message);
 
-  WordList base = get_malloced_wordlist("./top3000en.txt");
-  WordList w_list;
+  draw_rankings(scr, &f->ranks);
+  return scr->pen.row;
+}
+
+// the whole frame of a lesson
+static void draw_lesson(Screen *scr, const Text *text, const Frame *f) {
+  SCR_clear(scr);
+  T_draw_all(*text, scr);
+  draw_preview(scr, text, f);
+  draw_header(scr, f);
+}
+
+// fit the screen to the terminal
+static void fit_screen(Screen *scr) {
+  struct winsize w = {0};
+  ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+  if (w.ws_row != scr->rows || w.ws_col != scr->cols) {
+    SCR_resize(scr, w.ws_row, w.ws_col);
+  }
+}
+
+// fit the screen and break the lines again below the header
+static void relayout(Screen *scr, Text *text, const Frame *f) {
+  fit_screen(scr);
+  SCR_clear(scr);
+  T_layout(text, scr->rows, scr->cols, draw_header(scr, f));
+}
+
+#if 0
+int main() {
+  Arena arena = arena_new(LESSON_ARENA_SIZE);
+  init_crc_table();
+  StatsStore store;
+  SS_open(&store, false);
+  ConfMatrix *confusions = store.confusions;
+  BigramTable *bt = store.bt;
+  MonoGramDataSummary *mds = store.mds;
+  NGramStats ng = NG_open(false);
+
+  Rng rng = rng_seed(crc32((char *)confusions, sizeof(ConfMatrix)));
+
+  WordList base = get_mmapped_wordlist("./top3000en.txt");
+  BigramPostings postings = BP_build(&base);
+  WordListView w_list;
   if (memcmp(mds, &(MonoGramDataSummary){0}, sizeof(MonoGramDataSummary)) ==
       0) {
-    WL_deepcopy(&base, &w_list);
+    w_list = WLV_all(&base);
   } else {
-    w_list = WL_update(&base, mds, bt);
+    w_list = WL_update(&base, mds, bt, &postings, &ng, &rng, &arena);
   }
 
   for (int i = 0; i < w_list.nwords; ++i) {
-    printf(SL_FMT"\n", SL_FP(w_list.words[i]));
+    printf(SL_FMT"\n", SL_FP(base.words[WLV_id(&w_list, i)]));
   }
 
-  WL_free(w_list);
+  NG_close(&ng);
+  SS_close(&store);
+  arena_free(&arena);
+  BP_free(postings);
   WL_free(base);
 }
 
 #else
-int main() {
+int main(int argc, char **argv) {
+  // lines follow each other without lessons in between
+  const bool endless = argc > 1 && strcmp(argv[1], "-e") == 0;
+  if (endless) {
+    --argc;
+    ++argv;
+  }
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [-e] [corpus file]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
   // set up interrupt handler
   struct sigaction sigterm_action = {0};
   sigterm_action.sa_handler = &sigint_handler;
@@ -258,123 +387,170 @@ int main() {
     fprintf(stderr, "Error registering signal handler\nExiting...\n");
     exit(EXIT_FAILURE);
   }
+  // without SA_RESTART, so a resize wakes up the wait for the next key
+  struct sigaction sigwinch_action = {0};
+  sigwinch_action.sa_handler = &sigwinch_handler;
+  if (sigaction(SIGWINCH, &sigwinch_action, NULL) != 0) {
+    fprintf(stderr, "Error registering signal handler\nExiting...\n");
+    exit(EXIT_FAILURE);
+  }
   init_crc_table();
   char post_message[POST_BUF_SZ];
   memset(post_message, 0x0, POST_BUF_SZ);
+  char status[POST_BUF_SZ] = {0};
+
+  // compiled through the checksum keyed cache, so edits to the text apply
+  WordList base;
+  TwlIndex twl_index;
+  BigramPostings postings;
+  bool compiled;
+  if (argc == 2) {
+    // arbitrary text, keep only the most frequent words
+    compiled = WL_load_cached(argv[1], CORPUS_DEFAULT_WORDS, &load_corpus,
+                              &base, &twl_index);
+  } else {
+    compiled = WL_load_cached("./top3000en.txt", 0, &get_mmapped_wordlist,
+                              &base, &twl_index);
+  }
+  postings = compiled ? TWL_postings(&twl_index) : BP_build(&base);
+
+  Arena arena = arena_new(LESSON_ARENA_SIZE);
+
+  // stats stay in memory, lessons are appended to the journal
+  StatsStore store;
+  SS_open(&store, true);
+  ConfMatrix *confusions = store.confusions;
+  MonoGramDataSummary *mds = store.mds;
+  BigramTable *bt = store.bt;
+  NGramStats ng = NG_open(true);
+  LessonHistory history = LH_open();
+  // everything on the terminal is drawn through it, one write per frame
+  Screen scr = SCR_new(0, 0);
+  IN_init();
+
+  SampleCtx sample_ctx = {
+      .base = &base,
+      .confusions = confusions,
+      .mds = mds,
+      .bt = bt,
+      .postings = &postings,
+      .ng = &ng,
+  };
+  // the next lines are sampled while the current one is typed
+  LineStream stream;
+  if (endless) {
+    ST_start(&stream, &sample_words, &sample_ctx,
+             crc32((char *)confusions, sizeof(ConfMatrix)));
+  }
+  bool started = false;
+  // keys are timed from the previous correct key, the space starts
+  uint64_t start = 0;
+  // suppress echoing
+  init_term();
 
-  // create ConfMatrix if no file is found, else load data from file
-  WordList base = get_malloced_wordlist("./top3000en.txt");
   while (!canceled) {
     run = true;
-    ConfMatrix *confusions = calloc(1, sizeof(ConfMatrix));
-    BigramTable *bt = calloc(1, sizeof(BigramTable));
-    MonoGramDataSummary *mds = calloc(1, sizeof(MonoGramDataSummary));
-
-    FILE *data_file = fopen(STORAGE_NAME, "r");
-    if (errno) {
-      if (errno == ENOENT) {
-        // file does not exist
-      } else {
-        fprintf(stderr, "Error opening storage file '%s': %s\nExiting...\n",
-                STORAGE_NAME, strerror(errno));
-        exit(EXIT_FAILURE);
-      }
-    } else {
-      fseek(data_file, 0, SEEK_SET);
-      fread(confusions, sizeof(ConfMatrix), 1, data_file);
-      fread(mds, sizeof(MonoGramDataSummary), 1, data_file);
-      fread(bt, sizeof(BigramTable), 1, data_file);
-      fclose(data_file);
-    }
-
-    srand(crc32((char *)confusions, sizeof(ConfMatrix)));
-
-    WordList w_list;
-    if (validate_persist(mds, confusions, bt)) {
-      WL_deepcopy(&base, &w_list);
-    } else {
-      w_list = WL_update(&base, mds, bt);
-    }
 
+    Frame frame = {.status = status, .post_message = post_message};
     int cur_line[LINE_SIZE_WORDS] = {0};
-    for (int i = 0; i < LINE_SIZE_WORDS; ++i) {
-      cur_line[i] = rand() % w_list.nwords;
-    }
-
-    // get terminal size
-    struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    // suppress echoing
-    init_term();
-
-    Text text =
-        T_create(&w_list, w.ws_row, w.ws_col, cur_line, LINE_SIZE_WORDS);
-
-    clear();
-    T_draw_all(text);
-
-    TermPos term_pos = text.t_line_starts[0];
-
-    goto_term_pos((TermPos){0});
-    printf("Press [[space]] to start\n");
-    printf("%s\n", post_message);
-
-    goto_term_pos((TermPos){5, 0});
-
-    BigramInfo *bi = BI_list_new(bt);
-    ChrInfo *ci = CI_list_new(mds);
-    qsort(bi, N_CHARS * N_CHARS, sizeof(BigramInfo), &BI_gt);
-    qsort(ci, N_CHARS, sizeof(ChrInfo), &CI_gt);
-
-    printf("Worst %i chars:\n", WORST_N);
-    for (int i = 0; i < WORST_N; ++i) {
-      printf("'%c'  ", ci[i].c);
-    }
-
-    printf("\nWorst %i bigrams:\n", WORST_N);
-    for (int i = 0; i < WORST_N; ++i) {
-      printf("'%s' ", bi[i].bigram);
-    }
-
-    qsort(bi, N_CHARS * N_CHARS, sizeof(BigramInfo), &BI_lt);
-    qsort(ci, N_CHARS, sizeof(ChrInfo), &CI_lt);
-
-    printf("\nBest %i chars:\n", WORST_N);
-    for (int i = 0; i < WORST_N; ++i) {
-      printf("'%c'  ", ci[i].c);
+    if (endless) {
+      for (int l = 0; l < ENDLESS_LESSON_LINES; ++l) {
+        const StreamLine line = ST_next(&stream);
+        memcpy(&cur_line[l * STREAM_LINE_WORDS], line.words,
+               sizeof(line.words));
+      }
+      frame.n_preview = ST_peek(&stream, frame.preview, PREVIEW_LINES);
+    } else {
+      Rng rng = rng_seed(crc32((char *)confusions, sizeof(ConfMatrix)));
+      WordListView w_list = sample_words(&sample_ctx, &rng, &arena);
+      for (int i = 0; i < LINE_SIZE_WORDS; ++i) {
+        cur_line[i] = (int)WLV_id(&w_list, rng_below(&rng, w_list.nwords));
+      }
     }
 
-    printf("\nBest %i bigrams:\n", WORST_N);
-    for (int i = 0; i < WORST_N; ++i) {
-      printf("'%s' ", bi[i].bigram);
+    long n_bi = 0;
+    RankEntry *bi = BI_list_new(bt, &arena, &n_bi);
+    RankEntry *ci = CI_list_new(mds, &arena);
+    Rankings *ranks = &frame.ranks;
+    RANK_select(ci, N_CHARS, WORST_N, ranks->worst_ci, &ranks->n_worst_ci,
+                ranks->best_ci, &ranks->n_best_ci);
+    RANK_select(bi, n_bi, WORST_N, ranks->worst_bi, &ranks->n_worst_bi,
+                ranks->best_bi, &ranks->n_best_bi);
+
+    // endless lines follow each other, only the first waits for the space
+    const bool wait_space = !endless || !started;
+    if (wait_space) {
+      snprintf(status, POST_BUF_SZ, "Press [[space]] to start");
     }
 
-    while (run) {
-      char c = getchar();
-      if (c == ' ') {
+    // the text goes below the header as it is drawn
+    resized = false;
+    fit_screen(&scr);
+    SCR_clear(&scr);
+    const int header_rows = draw_header(&scr, &frame);
+    Text text = T_create(&arena, &base, scr.rows, scr.cols, header_rows,
+                         cur_line, LINE_SIZE_WORDS);
+    draw_lesson(&scr, &text, &frame);
+    SCR_flush(&scr);
+
+    KeyEvent ev = {0};
+    while (run && wait_space) {
+      if (resized) {
+        resized = false;
+        relayout(&scr, &text, &frame);
+        draw_lesson(&scr, &text, &frame);
+        SCR_flush(&scr);
+      }
+      if (!IN_next(&ev)) {
+        canceled |= IN_closed();
+        run = !canceled;
+        continue;
+      }
+      if (ev.c == ' ') {
         break;
       }
     }
-    goto_term_pos((TermPos){0});
-    printf("                        ");
-    goto_term_pos(term_pos);
+    if (wait_space) {
+      status[0] = '\0';
+      SCR_goto(&scr, (TermPos){0});
+      SCR_printf(&scr, "                        ");
+      start = ev.time_ns;
+      started = true;
+    }
+    TermPos term_pos = T_cursor(&text);
+    SCR_goto(&scr, term_pos);
 
-    struct timeval start, end;
     bool cur_char_wrong = false;
-    gettimeofday(&start, NULL);
     while (run) {
-      char c = getchar();
+      if (resized) {
+        // the lines are broken again, the typed chars keep their colors
+        resized = false;
+        relayout(&scr, &text, &frame);
+        draw_lesson(&scr, &text, &frame);
+        term_pos = T_cursor(&text);
+        SCR_goto(&scr, term_pos);
+      }
+      // keys that queued up while drawing are handled before the next frame
+      if (!IN_pending()) {
+        SCR_flush(&scr);
+      }
+      if (!IN_next(&ev)) {
+        canceled |= IN_closed();
+        run = !canceled;
+        continue;
+      }
+      char c = ev.c;
       // skip unprintable and control characters
       if (c < KC_SPC || c == KC_DEL) {
         continue;
       }
-      gettimeofday(&end, NULL);
-      const double time_ms = (double)(end.tv_sec - start.tv_sec) * 1000.0 +
-                             (double)(end.tv_usec - start.tv_usec) / 1000.0;
+      const double time_ms = (double)(ev.time_ns - start) / 1000000.0;
+      T_record_event(&text, c, ev.time_ns);
 
-      goto_term_pos((TermPos){1, 0});
-      printf("Current Key Time: %.2f", time_ms);
-      goto_term_pos(term_pos);
+      snprintf(status, POST_BUF_SZ, "Current Key Time: %.2f", time_ms);
+      SCR_goto(&scr, (TermPos){1, 0});
+      SCR_printf(&scr, "%s", status);
+      SCR_goto(&scr, term_pos);
 
       if (!cur_char_wrong) {
         text.typedchars[text.cur_char] = c;
@@ -382,18 +558,22 @@ int main() {
       }
 
       if (c == text.chars[text.cur_char]) {
-        goto_term_pos(term_pos);
         if (c == ' ') {
           c = '_';
         }
-        fprintf(stdout, "%s%c" RST, (cur_char_wrong ? RED : GRN), c);
+        SCR_printf(&scr, "%s%c" RST, (cur_char_wrong ? RED : GRN), c);
 
+        const int top_line = text.top_line;
         if (!T_advance_char(&text, &term_pos)) {
           run = false;
+        } else if (text.top_line != top_line) {
+          // scrolled, only the lines in view are drawn
+          draw_lesson(&scr, &text, &frame);
         }
+        SCR_goto(&scr, term_pos);
 
         cur_char_wrong = false;
-        gettimeofday(&start, NULL);
+        start = ev.time_ns;
       } else {
         cur_char_wrong = true;
         text.errors[text.cur_char] = true;
@@ -402,28 +582,29 @@ int main() {
     }
 
     if (!canceled) {
-      update_conf_matrix(confusions, &text);
+      // recent stats decay by lesson, this one is recorded as the next. It
+      // is in the journal before the stats change.
+      const uint32_t tick = (uint32_t)store.seq + 1;
+      SS_log_lesson(&store, &text, tick);
+
+      // the generator samples the following lines from the stats
+      if (endless) {
+        ST_lock_stats(&stream);
+      }
+      SS_apply_lesson(&store);
+      NG_update(&ng, &text);
+      if (endless) {
+        ST_unlock_stats(&stream);
+      }
 
-      MDS_update(mds, &text);
       double total_time_ms = 0;
       for (int i = 0; i < text.n_chars; ++i) {
         total_time_ms += text.time_to_type[i];
       }
-
-      BT_update(bt, &text);
-
-      FILE *outfile = fopen(STORAGE_NAME, "w+");
-      if (errno) {
-        fprintf(stderr, "Error opening file %s for storage: %s\n", STORAGE_NAME,
-                strerror(errno));
-        exit(EXIT_FAILURE);
-      }
-      dump_stats_bin(outfile, mds, confusions, bt);
-      fclose(outfile);
+      LH_append(&history, &text, store.seq);
 
       const double cpm = (double)text.n_chars / total_time_ms * 60.0 * 1000.0;
 
-      goto_term_pos((TermPos){1, 0});
       memset(post_message, 0x0, POST_BUF_SZ);
       snprintf(post_message, POST_BUF_SZ,
                GRN "Accuracy" RST ": %5.2f%% (%4i / %4i)\n" GRN
@@ -431,11 +612,24 @@ int main() {
                (float)(text.n_chars - text.n_errors) / (float)text.n_chars,
                text.n_chars - text.n_errors, text.n_chars, cpm, cpm / 5.0f);
     }
-    WL_free(w_list);
+    // everything allocated for this lesson is gone at once, in endless
+    // mode the typed lines
+    arena_reset(&arena);
+  }
+
+  if (endless) {
+    ST_stop(&stream);
   }
 
+  LH_close(&history);
+  NG_close(&ng);
+  SS_close(&store);
+  arena_free(&arena);
+  BP_free(postings);
   WL_free(base);
+  SCR_free(&scr);
   // reset terminal
+  IN_deinit();
   goto_term_pos((TermPos){0});
   deinit_term();
   deinit_crc_table();
@@ -0,0 +1,229 @@
+#include "ngram.h"
+
+#include "errno.h"
+#include "fcntl.h"
+#include "file_util.h"
+#include "keys.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+// independent hash per sketch row
+static const uint64_t row_seeds[NG_DEPTH] = {
+    0x9e3779b97f4a7c15ull,
+    0xbf58476d1ce4e5b9ull,
+    0x94d049bb133111ebull,
+    0xd6e8feb86659fd93ull,
+};
+
+static void exit_err_ngram(const char *msg) {
+  fprintf(stderr, "%s '%s': %s\nExiting...\n", msg, NGRAM_STORAGE_NAME,
+          strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+// unique for every gram of up to NG_MAX_N keys
+static uint64_t NG_key(const char *gram, int n) {
+  uint64_t key = (uint64_t)n;
+  for (int i = 0; i < n; ++i) {
+    key = (key << 7) | (uint64_t)char_idx(gram[i]);
+  }
+  return key;
+}
+
+static uint32_t NG_slot(uint64_t key, int row) {
+  uint64_t h = key ^ row_seeds[row];
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  h ^= h >> 31;
+  return (uint32_t)(h & (NG_WIDTH - 1));
+}
+
+static void NG_init_header(NGramHeader *header) {
+  memcpy(header->magic, NG_MAGIC, sizeof(header->magic));
+  header->version = NG_VERSION;
+  header->byte_order = NG_BYTE_ORDER;
+  header->alphabet_size = N_CHARS;
+  header->width = NG_WIDTH;
+  header->depth = NG_DEPTH;
+  header->top_k = NG_TOP_K;
+}
+
+static void NG_check_header(const NGramHeader *header, long size) {
+  NGramHeader expected = {0};
+  NG_init_header(&expected);
+  if (size != (long)sizeof(NGramFile) ||
+      memcmp(header, &expected, sizeof(expected)) != 0) {
+    fprintf(stderr,
+            "N-gram file '%s' has an unsupported version or layout\n"
+            "Exiting...\n",
+            NGRAM_STORAGE_NAME);
+    exit(EXIT_FAILURE);
+  }
+}
+
+NGramStats NG_open(bool writable) {
+  errno = 0;
+  const int fd = open(NGRAM_STORAGE_NAME, writable ? O_RDWR | O_CREAT : O_RDONLY,
+                      0644);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      exit_err_ngram("Error opening n-gram file");
+    }
+    // read-only and no file yet
+    errno = 0;
+    return (NGramStats){.file = calloc(1, sizeof(NGramFile))};
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    exit_err_ngram("Error reading n-gram file");
+  }
+  const bool created = st.st_size == 0;
+  if (created) {
+    if (!writable) {
+      close(fd);
+      return (NGramStats){.file = calloc(1, sizeof(NGramFile))};
+    }
+    if (ftruncate(fd, sizeof(NGramFile)) != 0) {
+      exit_err_ngram("Error creating n-gram file");
+    }
+  } else {
+    NGramHeader header = {0};
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+      memset(&header, 0x0, sizeof(header));
+    }
+    NG_check_header(&header, st.st_size);
+  }
+
+  NGramStats ret = {.mapped = writable};
+  if (writable) {
+    ret.file = mmap(NULL, sizeof(NGramFile), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    if (ret.file == MAP_FAILED) {
+      exit_err_ngram("Error mapping n-gram file");
+    }
+    if (created) {
+      NG_init_header(&ret.file->header);
+    }
+  } else {
+    ret.file = malloc(sizeof(NGramFile));
+    if (pread(fd, ret.file, sizeof(NGramFile), 0) != sizeof(NGramFile)) {
+      exit_err_ngram("Error reading n-gram file");
+    }
+  }
+  close(fd);
+  errno = 0;
+  return ret;
+}
+
+// keep gram in the top list of its n if it is among the most missed
+static void NG_offer(NGramFile *f, const char *gram, int n, uint32_t misses) {
+  NGramTop *top = f->top[n - NG_MIN_N];
+  uint32_t *n_top = &f->n_top[n - NG_MIN_N];
+
+  uint32_t min = 0;
+  for (uint32_t i = 0; i < *n_top; ++i) {
+    if (memcmp(top[i].gram, gram, (unsigned long)n) == 0) {
+      top[i].misses = misses;
+      return;
+    }
+    if (top[i].misses < top[min].misses) {
+      min = i;
+    }
+  }
+
+  if (*n_top < NG_TOP_K) {
+    min = (*n_top)++;
+  } else if (top[min].misses >= misses) {
+    return;
+  }
+  top[min] = (NGramTop){.n = (uint8_t)n, .misses = misses};
+  memcpy(top[min].gram, gram, (unsigned long)n);
+}
+
+static void NG_add(NGramFile *f, const char *gram, int n, bool missed,
+                   double time) {
+  const uint64_t key = NG_key(gram, n);
+  uint32_t est_misses = UINT32_MAX;
+  for (int row = 0; row < NG_DEPTH; ++row) {
+    const uint32_t slot = NG_slot(key, row);
+    ++f->occurrences[row][slot];
+    f->times[row][slot] += time;
+    f->misses[row][slot] += missed;
+    if (f->misses[row][slot] < est_misses) {
+      est_misses = f->misses[row][slot];
+    }
+  }
+  if (missed) {
+    NG_offer(f, gram, n, est_misses);
+  }
+}
+
+void NG_update(NGramStats *ng, const Text *t) {
+  for (int i = 0; i < t->n_chars; ++i) {
+    // grams starting at i share their prefix, so extend them one key at a time
+    bool missed = false;
+    double time = 0.0;
+    for (int len = 1; len <= NG_MAX_N && i + len <= t->n_chars; ++len) {
+      const int j = i + len - 1;
+      if (t->chars[j] == ' ') {
+        break;
+      }
+      missed |= t->chars[j] != t->typedchars[j];
+      time += t->time_to_type[j];
+      if (len >= NG_MIN_N) {
+        NG_add(ng->file, &t->chars[i], len, missed, time);
+      }
+    }
+  }
+}
+
+NGramCount NG_estimate(const NGramStats *ng, const char *gram, int n) {
+  const NGramFile *f = ng->file;
+  const uint64_t key = NG_key(gram, n);
+  NGramCount ret = {.occurrences = UINT32_MAX, .misses = UINT32_MAX};
+  for (int row = 0; row < NG_DEPTH; ++row) {
+    const uint32_t slot = NG_slot(key, row);
+    if (f->occurrences[row][slot] < ret.occurrences) {
+      ret.occurrences = f->occurrences[row][slot];
+    }
+    if (f->misses[row][slot] < ret.misses) {
+      ret.misses = f->misses[row][slot];
+    }
+    if (row == 0 || f->times[row][slot] < ret.time) {
+      ret.time = f->times[row][slot];
+    }
+  }
+  return ret;
+}
+
+void NG_dump_csv(const NGramStats *ng) {
+  FILE *ng_file = fopen("./ngrams.csv", "w");
+  fprintf(ng_file, "n,gram,occurrences,misses,avg_time\n");
+  for (int size = 0; size < NG_N_SIZES; ++size) {
+    for (uint32_t i = 0; i < ng->file->n_top[size]; ++i) {
+      const NGramTop *top = &ng->file->top[size][i];
+      const NGramCount c = NG_estimate(ng, top->gram, top->n);
+
+      fprintf(ng_file, "%i,", top->n);
+      write_csv_quoted(ng_file, top->gram, top->n);
+      fprintf(ng_file, ",%u,%u,%f\n", c.occurrences, c.misses,
+              c.occurrences > 0 ? c.time / c.occurrences : 0.0);
+    }
+  }
+  fclose(ng_file);
+}
+
+void NG_close(NGramStats *ng) {
+  if (ng->mapped) {
+    msync(ng->file, sizeof(NGramFile), MS_SYNC);
+    munmap(ng->file, sizeof(NGramFile));
+  } else {
+    free(ng->file);
+  }
+  *ng = (NGramStats){0};
+}
@@ -0,0 +1,107 @@
+#ifndef NGRAM_H
+#define NGRAM_H
+
+#include "stdbool.h"
+#include "stdint.h"
+#include "text.h"
+
+#define NGRAM_STORAGE_NAME "typtr_ngrams.dat"
+#define NG_MAGIC "TYPN"
+#define NG_VERSION 1
+#define NG_BYTE_ORDER 0x01020304u
+
+#define NG_MIN_N 3
+#define NG_MAX_N 5
+#define NG_N_SIZES (NG_MAX_N - NG_MIN_N + 1)
+// count-min sketch dimensions, width is a power of two
+#define NG_WIDTH 2048
+#define NG_DEPTH 4
+// heavy hitters kept per n
+#define NG_TOP_K 32
+
+/** candidate for the most missed n-grams */
+typedef struct {
+  char gram[NG_MAX_N];
+  uint8_t n;
+  uint32_t misses; //< sketch estimate at the last update
+} NGramTop;
+
+/**
+ * On-disk header of the n-gram file. Integers are stored in host byte order,
+ * the sketch dimensions have to match the compiled ones.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t alphabet_size; //< N_CHARS at write time
+  uint32_t width;
+  uint32_t depth;
+  uint32_t top_k;
+  uint32_t pad;
+} NGramHeader;
+
+/**
+ * Layout of the n-gram file, mapped as a whole.
+ */
+typedef struct {
+  NGramHeader header;
+
+  // one count-min sketch per field, all n share them
+  uint32_t occurrences[NG_DEPTH][NG_WIDTH];
+  uint32_t misses[NG_DEPTH][NG_WIDTH];
+  double times[NG_DEPTH][NG_WIDTH]; //< summed time to type the gram
+
+  NGramTop top[NG_N_SIZES][NG_TOP_K];
+  uint32_t n_top[NG_N_SIZES];
+} NGramFile;
+
+/**
+ * Approximate stats of all n-grams with NG_MIN_N <= n <= NG_MAX_N that do not
+ * contain a space.
+ *
+ * Counts come from count-min sketches, so memory is fixed no matter how many
+ * distinct n-grams are typed and estimates never undercount. The most missed
+ * n-grams of every n are tracked in small top-K lists, so lessons can target
+ * them without enumerating the sketch. The file is mapped MAP_SHARED and
+ * updated in place. Unlike the stats store it has no journal, losing the last
+ * lesson to a system crash only makes the estimates slightly lower.
+ */
+typedef struct {
+  NGramFile *file;
+  bool mapped; //< false if file was allocated in memory
+} NGramStats;
+
+/** sketch estimates of a single n-gram */
+typedef struct {
+  uint32_t occurrences;
+  uint32_t misses;
+  double time;
+} NGramCount;
+
+/**
+ * @brief map the n-gram file, creating it if writable
+ *
+ * @param writable update the file in place. Otherwise the stats are read
+ *                 into memory.
+ */
+NGramStats NG_open(bool writable);
+
+/**
+ * @brief add every n-gram of the lesson t to the sketches and top lists
+ */
+void NG_update(NGramStats *ng, const Text *t);
+
+/**
+ * @brief sketch estimates for gram of length n
+ */
+NGramCount NG_estimate(const NGramStats *ng, const char *gram, int n);
+
+/**
+ * @brief write the top lists with their estimates to ./ngrams.csv
+ */
+void NG_dump_csv(const NGramStats *ng);
+
+void NG_close(NGramStats *ng);
+
+#endif // NGRAM_H
@@ -0,0 +1,108 @@
+#include "rank.h"
+
+#include "math.h"
+#include "stdbool.h"
+
+void RANK_err_rates(const Ewma *misses, const Ewma *occurrences, float *rates,
+                    long n) {
+  for (long i = 0; i < n; ++i) {
+    rates[i] = RANK_err_rate(misses[i], occurrences[i]);
+  }
+}
+
+// true if a ranks weaker than b, neither may have a NaN error rate
+static bool weaker(const RankEntry *a, const RankEntry *b) {
+  if (a->err_rate != b->err_rate) {
+    return a->err_rate > b->err_rate;
+  }
+  // an unknown time does not make a key slower
+  const float time_a = isnan(a->time) ? 0.0f : a->time;
+  const float time_b = isnan(b->time) ? 0.0f : b->time;
+  if (time_a != time_b) {
+    return time_a > time_b;
+  }
+  return a->id > b->id;
+}
+
+static bool stronger(const RankEntry *a, const RankEntry *b) {
+  return weaker(b, a);
+}
+
+typedef bool (*RankOrder)(const RankEntry *a, const RankEntry *b);
+
+/**
+ * Bounded heap of the k most extreme entries. The root is the least extreme
+ * one, which is replaced first. evicts(a, b) is true if a is less extreme
+ * than b.
+ */
+typedef struct {
+  RankEntry *entries;
+  long n;
+  long k;
+  RankOrder evicts;
+} RankHeap;
+
+static void RH_sift_down(RankHeap *h, long i) {
+  for (;;) {
+    long top = i;
+    const long l = 2 * i + 1;
+    const long r = l + 1;
+    if (l < h->n && h->evicts(&h->entries[l], &h->entries[top])) {
+      top = l;
+    }
+    if (r < h->n && h->evicts(&h->entries[r], &h->entries[top])) {
+      top = r;
+    }
+    if (top == i) {
+      return;
+    }
+    const RankEntry tmp = h->entries[i];
+    h->entries[i] = h->entries[top];
+    h->entries[top] = tmp;
+    i = top;
+  }
+}
+
+static void RH_offer(RankHeap *h, const RankEntry *e) {
+  if (h->n < h->k) {
+    long i = h->n++;
+    h->entries[i] = *e;
+    while (i > 0 && h->evicts(&h->entries[i], &h->entries[(i - 1) / 2])) {
+      const RankEntry tmp = h->entries[i];
+      h->entries[i] = h->entries[(i - 1) / 2];
+      h->entries[(i - 1) / 2] = tmp;
+      i = (i - 1) / 2;
+    }
+  } else if (h->k > 0 && h->evicts(&h->entries[0], e)) {
+    h->entries[0] = *e;
+    RH_sift_down(h, 0);
+  }
+}
+
+// heap sort in place, the most extreme entry ends up first
+static long RH_sort(RankHeap *h) {
+  const long n = h->n;
+  while (h->n > 1) {
+    const RankEntry root = h->entries[0];
+    h->entries[0] = h->entries[--h->n];
+    h->entries[h->n] = root;
+    RH_sift_down(h, 0);
+  }
+  return n;
+}
+
+void RANK_select(const RankEntry *entries, long n, long k, RankEntry *worst,
+                 long *n_worst, RankEntry *best, long *n_best) {
+  RankHeap worst_heap = {.entries = worst, .k = k, .evicts = &stronger};
+  RankHeap best_heap = {.entries = best, .k = k, .evicts = &weaker};
+  for (long i = 0; i < n; ++i) {
+    // never typed, neither weak nor strong
+    if (isnan(entries[i].err_rate)) {
+      continue;
+    }
+    RH_offer(&worst_heap, &entries[i]);
+    RH_offer(&best_heap, &entries[i]);
+  }
+  *n_worst = RH_sort(&worst_heap);
+  *n_best = RH_sort(&best_heap);
+}
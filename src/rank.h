@@ -0,0 +1,47 @@
+#ifndef RANK_H
+#define RANK_H
+
+#include "stats.h"
+#include "stdint.h"
+
+/** weakness of a key or bigram */
+typedef struct {
+  float err_rate; //< NaN if it was never typed
+  float time;     //< breaks ties, slower is weaker, NaN counts as 0
+  uint16_t id;    //< key index or first * N_CHARS + second
+} RankEntry;
+
+/**
+ * @brief recent error rate of a key or bigram, NaN if it was never typed
+ *
+ * The recent occurrences and misses of a cell are always updated at the same
+ * tick, so their decay cancels out and no tick is needed.
+ */
+static inline float RANK_err_rate(Ewma misses, Ewma occurrences) {
+  return misses.value / occurrences.value;
+}
+
+/**
+ * @brief RANK_err_rate of n cells at once
+ *
+ * Branch free, so the compiler can vectorize it.
+ */
+void RANK_err_rates(const Ewma *misses, const Ewma *occurrences, float *rates,
+                    long n);
+
+/**
+ * @brief the k weakest and k strongest of n entries in a single pass
+ *
+ * Entries are ordered by error rate, then by time, then by id, which is a
+ * strict total order. Entries with a NaN error rate are left out, so fewer
+ * than k may be found.
+ *
+ * @param worst k entries, set to the weakest ones, weakest first
+ * @param n_worst set to the number of entries in worst
+ * @param best k entries, set to the strongest ones, strongest first
+ * @param n_best set to the number of entries in best
+ */
+void RANK_select(const RankEntry *entries, long n, long k, RankEntry *worst,
+                 long *n_worst, RankEntry *best, long *n_best);
+
+#endif // RANK_H
@@ -0,0 +1,119 @@
+#include "sampler.h"
+
+#include "assert.h"
+#include "stdlib.h"
+
+static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+static uint64_t splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+Rng rng_seed(uint64_t seed) {
+  // expand the seed so that similar seeds give unrelated states
+  Rng ret;
+  for (int i = 0; i < 4; ++i) {
+    ret.s[i] = splitmix64(&seed);
+  }
+  return ret;
+}
+
+uint64_t rng_next(Rng *rng) {
+  uint64_t *s = rng->s;
+  const uint64_t result = rotl(s[1] * 5, 7) * 9;
+  const uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+long rng_below(Rng *rng, long n) {
+  assert(n > 0);
+  // Lemire's multiply and reject, rejects with probability < n / 2^64
+  const uint64_t range = (uint64_t)n;
+  __uint128_t m = (__uint128_t)rng_next(rng) * range;
+  uint64_t low = (uint64_t)m;
+  if (low < range) {
+    const uint64_t threshold = -range % range;
+    while (low < threshold) {
+      m = (__uint128_t)rng_next(rng) * range;
+      low = (uint64_t)m;
+    }
+  }
+  return (long)(m >> 64);
+}
+
+static double rng_unit(Rng *rng) {
+  return (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+AliasTable AT_build(const double *weights, long n) {
+  assert(n > 0);
+  AliasTable ret = {
+      .prob = malloc((unsigned long)n * sizeof(double)),
+      .alias = malloc((unsigned long)n * sizeof(long)),
+      .n = n,
+  };
+
+  double total = 0.0;
+  for (long i = 0; i < n; ++i) {
+    assert(weights[i] >= 0.0);
+    total += weights[i];
+  }
+
+  // small and large stack from both ends of one worklist
+  long *work = malloc((unsigned long)n * sizeof(long));
+  long n_small = 0;
+  long n_large = 0;
+  for (long i = 0; i < n; ++i) {
+    ret.prob[i] = total > 0.0 ? weights[i] * (double)n / total : 1.0;
+    ret.alias[i] = i;
+    if (ret.prob[i] < 1.0) {
+      work[n_small++] = i;
+    } else {
+      work[n - 1 - n_large++] = i;
+    }
+  }
+
+  while (n_small > 0 && n_large > 0) {
+    const long small = work[--n_small];
+    const long large = work[n - n_large];
+
+    ret.alias[small] = large;
+    ret.prob[large] -= 1.0 - ret.prob[small];
+    if (ret.prob[large] < 1.0) {
+      --n_large;
+      work[n_small++] = large;
+    }
+  }
+
+  // leftovers only differ from 1 by rounding errors
+  for (long i = 0; i < n_small; ++i) {
+    ret.prob[work[i]] = 1.0;
+  }
+  for (long i = 0; i < n_large; ++i) {
+    ret.prob[work[n - 1 - i]] = 1.0;
+  }
+
+  free(work);
+  return ret;
+}
+
+long AT_draw(const AliasTable *at, Rng *rng) {
+  const long i = rng_below(rng, at->n);
+  return rng_unit(rng) < at->prob[i] ? i : at->alias[i];
+}
+
+void AT_free(AliasTable at) {
+  free(at.prob);
+  free(at.alias);
+}
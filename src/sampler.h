@@ -0,0 +1,50 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "stdint.h"
+
+/**
+ * xoshiro256** pseudo random number generator state
+ */
+typedef struct {
+  uint64_t s[4];
+} Rng;
+
+/**
+ * @brief create Rng from a seed
+ *
+ * The same seed always produces the same sequence.
+ */
+Rng rng_seed(uint64_t seed);
+
+/** next 64 random bits */
+uint64_t rng_next(Rng *rng);
+
+/** uniform random number in [0, n) without modulo bias, n > 0 */
+long rng_below(Rng *rng, long n);
+
+/**
+ * Vose alias table for drawing indices proportional to their weights in O(1)
+ */
+typedef struct {
+  double *prob;
+  long *alias;
+  long n;
+} AliasTable;
+
+/**
+ * @brief build alias table from non-negative weights
+ *
+ * If all weights are zero, indices are drawn uniformly.
+ *
+ * @param weights weight per index
+ * @param n number of weights, n > 0
+ */
+AliasTable AT_build(const double *weights, long n);
+
+/** draw an index proportional to its weight */
+long AT_draw(const AliasTable *at, Rng *rng);
+
+void AT_free(AliasTable at);
+
+#endif // SAMPLER_H
@@ -0,0 +1,160 @@
+#include "screen.h"
+
+#include "errno.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+
+// bytes a single changed cell can need: move, color and the char
+#define CELL_OUT_MAX 32
+
+static const Cell blank = {' ', 0};
+
+static void fill_blank(Cell *cells, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    cells[i] = blank;
+  }
+}
+
+static size_t n_cells(const Screen *s) {
+  return (size_t)s->rows * (size_t)s->cols;
+}
+
+Screen SCR_new(int rows, int cols) {
+  Screen s = {0};
+  SCR_resize(&s, rows, cols);
+  return s;
+}
+
+void SCR_resize(Screen *s, int rows, int cols) {
+  // a failed size query gives 0
+  s->rows = rows > 0 ? rows : 1;
+  s->cols = cols > 0 ? cols : 1;
+  const size_t n = n_cells(s);
+  s->cells = realloc(s->cells, n * sizeof(Cell));
+  s->shown = realloc(s->shown, n * sizeof(Cell));
+  fill_blank(s->cells, n);
+  fill_blank(s->shown, n);
+  s->out_cap = n * CELL_OUT_MAX + 64;
+  s->out = realloc(s->out, s->out_cap);
+  s->full = true;
+}
+
+void SCR_free(Screen *s) {
+  free(s->cells);
+  free(s->shown);
+  free(s->out);
+  *s = (Screen){0};
+}
+
+void SCR_clear(Screen *s) { fill_blank(s->cells, n_cells(s)); }
+
+void SCR_goto(Screen *s, TermPos pos) { s->pen = pos; }
+
+static void SCR_put(Screen *s, char c) {
+  const int row = s->pen.row > 0 ? s->pen.row : 1;
+  const int col = s->pen.col > 0 ? s->pen.col : 1;
+  if (row <= s->rows && col <= s->cols) {
+    s->cells[(row - 1) * s->cols + col - 1] = (Cell){c, s->sgr};
+  }
+  s->pen = (TermPos){row, col + 1};
+}
+
+void SCR_printf(Screen *s, const char *fmt, ...) {
+  char buf[256];
+  char *str = buf;
+  va_list args;
+  va_start(args, fmt);
+  va_list args_copy;
+  va_copy(args_copy, args);
+  int len = vsnprintf(buf, sizeof(buf), fmt, args);
+  if (len >= (int)sizeof(buf)) {
+    str = malloc((size_t)len + 1);
+    vsnprintf(str, (size_t)len + 1, fmt, args_copy);
+  }
+  va_end(args_copy);
+  va_end(args);
+
+  for (int i = 0; i < len; ++i) {
+    if (str[i] == '\033' && i + 1 < len && str[i + 1] == '[') {
+      // color sequences like RED, GRN and RST
+      int code = 0;
+      int j = i + 2;
+      for (; j < len && str[j] >= '0' && str[j] <= '9'; ++j) {
+        code = code * 10 + str[j] - '0';
+      }
+      if (j < len && str[j] == 'm') {
+        s->sgr = (uint8_t)code;
+        i = j;
+      }
+    } else if (str[i] == '\n') {
+      s->pen = (TermPos){(s->pen.row > 0 ? s->pen.row : 1) + 1, 1};
+    } else {
+      SCR_put(s, str[i]);
+    }
+  }
+
+  if (str != buf) {
+    free(str);
+  }
+}
+
+void SCR_flush(Screen *s) {
+  char *o = s->out;
+  if (s->full) {
+    o += sprintf(o, "\033[0m\033[H\033[J");
+    fill_blank(s->shown, n_cells(s));
+    s->full = false;
+  }
+
+  // the cursor of the terminal, -1 if unknown
+  int cur_row = -1;
+  int cur_col = -1;
+  uint8_t sgr = 0;
+  for (int row = 0; row < s->rows; ++row) {
+    for (int col = 0; col < s->cols; ++col) {
+      const Cell *cell = &s->cells[row * s->cols + col];
+      Cell *shown = &s->shown[row * s->cols + col];
+      if (cell->ch == shown->ch && cell->sgr == shown->sgr) {
+        continue;
+      }
+
+      if (row != cur_row || col != cur_col) {
+        o += sprintf(o, "\033[%d;%dH", row + 1, col + 1);
+      }
+      if (cell->sgr != sgr) {
+        sgr = cell->sgr;
+        o += sgr ? sprintf(o, "\033[0;%um", sgr) : sprintf(o, "\033[0m");
+      }
+      *o++ = cell->ch;
+      *shown = *cell;
+
+      cur_row = row;
+      cur_col = col + 1;
+      // the cursor waits for a wrap at the last column
+      if (cur_col == s->cols) {
+        cur_row = -1;
+      }
+    }
+  }
+  if (sgr != 0) {
+    o += sprintf(o, "\033[0m");
+  }
+  o += sprintf(o, "\033[%d;%dH", s->pen.row, s->pen.col);
+
+  const char *p = s->out;
+  size_t left = (size_t)(o - s->out);
+  while (left > 0) {
+    const ssize_t n = write(STDOUT_FILENO, p, left);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    p += n;
+    left -= (size_t)n;
+  }
+}
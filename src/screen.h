@@ -0,0 +1,76 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include "stdbool.h"
+#include "stddef.h"
+#include "stdint.h"
+#include "term_handler.h"
+
+// SGR color sequences SCR_printf understands
+#define RED "\033[31m"
+#define GRN "\033[34m"
+#define RST "\033[0m"
+
+/** one character on the screen with its SGR color code, 0 is the default */
+typedef struct {
+  char ch;
+  uint8_t sgr;
+} Cell;
+
+/**
+ * In-memory model of the terminal.
+ *
+ * Drawing only writes the cell grid of the next frame. SCR_flush diffs it
+ * against the frame the terminal shows and sends the changed cells with a
+ * single write, so a keystroke costs one syscall no matter how much was
+ * drawn. Positions are terminal coordinates like for goto_term_pos, rows and
+ * columns start at 1 and 0 is the same as 1.
+ */
+typedef struct {
+  int rows, cols;
+  Cell *cells; //< next frame
+  Cell *shown; //< frame on the terminal
+  bool full;   //< the terminal content is unknown, redraw everything
+
+  TermPos pen; //< where drawing continues, the cursor after a flush
+  uint8_t sgr; //< color of the pen
+
+  char *out; //< escape sequences of a flush
+  size_t out_cap;
+} Screen;
+
+/**
+ * @brief blank screen of the given size, the first flush redraws everything
+ */
+Screen SCR_new(int rows, int cols);
+
+/**
+ * @brief change the size, the frame is blanked and fully redrawn on flush
+ */
+void SCR_resize(Screen *s, int rows, int cols);
+
+void SCR_free(Screen *s);
+
+/** @brief blank the next frame */
+void SCR_clear(Screen *s);
+
+/** @brief move the pen */
+void SCR_goto(Screen *s, TermPos pos);
+
+/**
+ * @brief draw formatted text at the pen and advance it
+ *
+ * Like printf on the terminal: newlines go to the start of the next row and
+ * the SGR color sequences RED, GRN and RST set the color. Text outside the
+ * screen is dropped.
+ */
+void SCR_printf(Screen *s, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief send the difference to the shown frame and place the cursor at the
+ *        pen, in one write
+ */
+void SCR_flush(Screen *s);
+
+#endif // SCREEN_H
@@ -338,17 +338,14 @@ bool SL_contains(const SL a, const char *b, int len) {
   if (len > a.len)
     return false;
 
-  int seq_idx = 0;
-  int seq_start = 0;
-  while (seq_start < a.len - len) {
-    ++seq_start;
+  for (int seq_start = 0; seq_start <= a.len - len; ++seq_start) {
+    int seq_idx = 0;
     while (seq_idx < len && SL_at(a, seq_start + seq_idx) == b[seq_idx]) {
       ++seq_idx;
-      if (seq_idx == len) {
-        return true;
-      }
     }
-    seq_idx = 0;
+    if (seq_idx == len) {
+      return true;
+    }
   }
   return false;
 }
@@ -4,6 +4,7 @@
 
 #include "assert.h"
 #include "errno.h"
+#include "math.h"
 #include "stdint.h"
 #include "stdio.h"
 #include "stdlib.h"
@@ -41,12 +42,25 @@ uint32_t crc32(const char *bytes, long size) {
   return ret ^ 0xFFFFFFFF;
 }
 
-void update_conf_matrix(ConfMatrix *mat, Text *t) {
+float EWMA_at(Ewma e, uint32_t tick) {
+  if (e.value == 0.0f || tick <= e.tick) {
+    return e.value;
+  }
+  return e.value * (float)exp2(-(double)(tick - e.tick) / EWMA_HALF_LIFE);
+}
+
+void EWMA_add(Ewma *e, uint32_t tick, float x) {
+  e->value = EWMA_at(*e, tick) + x;
+  e->tick = tick;
+}
+
+void update_conf_matrix(ConfMatrix *mat, const Text *t, uint32_t tick) {
   mat->n_hits = t->n_chars;
   for (int i = 0; i < t->n_chars; ++i) {
     const int correct_idx = char_idx(t->chars[i]);
     const int actual_idx = char_idx(t->typedchars[i]);
     ++mat->matrix[correct_idx][actual_idx];
+    EWMA_add(&mat->recent[correct_idx][actual_idx], tick, 1.0f);
   }
 }
 
@@ -72,27 +86,54 @@ void print_conf_matrix(ConfMatrix *mat) {
   printf("\n");
 }
 
-void MDS_update(MonoGramDataSummary *mds, Text *t) {
-  for (int i = 0; i < N_CHARS; ++i) {
-    mds->times[i] *= mds->n_occurrences[i];
-  }
-
+void MDS_update(MonoGramDataSummary *mds, const Text *t, uint32_t tick) {
   for (int i = 0; i < t->n_chars; ++i) {
     const int chr_idx = char_idx(t->chars[i]);
-    if (t->chars[i] != t->typedchars[i]) {
+    const bool missed = t->chars[i] != t->typedchars[i];
+    if (missed) {
       ++mds->n_misses[chr_idx];
     }
     ++mds->n_occurrences[chr_idx];
-    mds->times[chr_idx] += t->time_to_type[i];
+    // also decays the counts of the key
+    EWMA_add(&mds->recent_occurrences[chr_idx], tick, 1.0f);
+    EWMA_add(&mds->recent_misses[chr_idx], tick, missed);
+    DIST_add(&mds->latency[chr_idx], mds->n_occurrences[chr_idx],
+             t->time_to_type[i]);
   }
+}
+
+// src decayed to src_tick is added as of tick 0
+static void EWMA_merge(Ewma *dst, Ewma src, uint32_t src_tick) {
+  dst->value += EWMA_at(src, src_tick);
+}
+
+void merge_conf_matrix(ConfMatrix *dst, const ConfMatrix *src,
+                       uint32_t src_tick) {
   for (int i = 0; i < N_CHARS; ++i) {
-    mds->times[i] /= (float)mds->n_occurrences[i];
+    for (int j = 0; j < N_CHARS; ++j) {
+      dst->matrix[i][j] += src->matrix[i][j];
+      EWMA_merge(&dst->recent[i][j], src->recent[i][j], src_tick);
+    }
+  }
+  dst->n_hits += src->n_hits;
+}
+
+void MDS_merge(MonoGramDataSummary *dst, const MonoGramDataSummary *src,
+               uint32_t src_tick) {
+  for (int c = 0; c < N_CHARS; ++c) {
+    DIST_merge(&dst->latency[c], dst->n_occurrences[c], &src->latency[c],
+               src->n_occurrences[c]);
+    dst->n_occurrences[c] += src->n_occurrences[c];
+    dst->n_misses[c] += src->n_misses[c];
+    EWMA_merge(&dst->recent_occurrences[c], src->recent_occurrences[c],
+               src_tick);
+    EWMA_merge(&dst->recent_misses[c], src->recent_misses[c], src_tick);
   }
 }
 
 void print_mds(MonoGramDataSummary *mds) {
   for (int i = 0; i < N_CHARS; ++i) {
-    printf("%5.1f ", mds->times[i]);
+    printf("%5.1f ", mds->latency[i].mean);
   }
   printf("\n");
   for (int i = 0; i < N_CHARS; ++i) {
@@ -105,39 +146,145 @@ void print_mds(MonoGramDataSummary *mds) {
   printf("\n");
 }
 
-void BT_update(BigramTable *b, const Text *t) {
+BigramTable BT_new(void) {
+  return (BigramTable){
+      .entries = calloc(BT_MIN_CAP, sizeof(BigramEntry)),
+      .cap = BT_MIN_CAP,
+  };
+}
+
+void BT_free(BigramTable *bt) {
+  if (bt->grow == NULL) {
+    free(bt->entries);
+  }
+  *bt = (BigramTable){0};
+}
+
+uint32_t BT_count(const BigramEntry *entries, uint32_t cap) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < cap; ++i) {
+    n += entries[i].key != 0;
+  }
+  return n;
+}
+
+static uint32_t BT_home(uint16_t key, uint32_t cap) {
+  uint32_t h = key * 2654435761u;
+  h ^= h >> 16;
+  return h & (cap - 1);
+}
+
+// slot holding key, or the free slot where it would be inserted
+static uint32_t BT_slot(const BigramEntry *entries, uint32_t cap,
+                        uint16_t key) {
+  uint32_t slot = BT_home(key, cap);
+  while (entries[slot].key != 0 && entries[slot].key != key) {
+    slot = (slot + 1) & (cap - 1);
+  }
+  return slot;
+}
+
+void BT_rehash(const BigramTable *bt, BigramEntry *to, uint32_t cap) {
+  for (uint32_t i = 0; i < bt->cap; ++i) {
+    const BigramEntry *e = &bt->entries[i];
+    if (e->key != 0) {
+      to[BT_slot(to, cap, e->key)] = *e;
+    }
+  }
+}
+
+static void BT_grow(BigramTable *bt, uint32_t cap) {
+  if (bt->grow) {
+    bt->grow(bt, cap, bt->grow_ctx);
+    return;
+  }
+  BigramEntry *entries = calloc(cap, sizeof(BigramEntry));
+  BT_rehash(bt, entries, cap);
+  free(bt->entries);
+  bt->entries = entries;
+  bt->cap = cap;
+}
+
+void BT_reserve(BigramTable *bt, uint32_t n) {
+  uint32_t cap = bt->cap;
+  // the load BT_get keeps
+  while (4 * n > 3 * cap) {
+    cap *= 2;
+  }
+  if (cap != bt->cap) {
+    assert(cap <= BT_MAX_CAP);
+    BT_grow(bt, cap);
+  }
+}
+
+static uint16_t BT_key(int first, int second) {
+  return (uint16_t)(first * N_CHARS + second + 1);
+}
+
+BigramEntry *BT_find(const BigramTable *bt, int first, int second) {
+  BigramEntry *e =
+      &bt->entries[BT_slot(bt->entries, bt->cap, BT_key(first, second))];
+  return e->key != 0 ? e : NULL;
+}
+
+BigramEntry *BT_get(BigramTable *bt, int first, int second) {
+  const uint16_t key = BT_key(first, second);
+  uint32_t slot = BT_slot(bt->entries, bt->cap, key);
+  if (bt->entries[slot].key == key) {
+    return &bt->entries[slot];
+  }
+
+  // keep the load at or below 3/4
+  if (4 * (bt->n + 1) > 3 * bt->cap) {
+    assert(bt->cap < BT_MAX_CAP);
+    BT_grow(bt, 2 * bt->cap);
+    slot = BT_slot(bt->entries, bt->cap, key);
+  }
+  bt->entries[slot] = (BigramEntry){.key = key};
+  ++bt->n;
+  return &bt->entries[slot];
+}
+
+void BT_update(BigramTable *b, const Text *t, uint32_t tick) {
   for (long i = 0; i < t->n_chars - 1; ++i) {
     const int c1no_act = char_idx(t->chars[i]);
     const int c2no_act = char_idx(t->chars[i + 1]);
     const int c1no_typ = char_idx(t->typedchars[i]);
     const int c2no_typ = char_idx(t->typedchars[i + 1]);
-    const float t1 = t->time_to_type[i];
-    const float t2 = t->time_to_type[i + 1];
-
-    b->avg_execution_time[c1no_act][c2no_act] *=
-        b->n_occurrences[c1no_act][c2no_act];
-
-    b->avg_execution_time[c1no_act][c2no_act] += t1 + t2;
+    const double t1 = t->time_to_type[i];
+    const double t2 = t->time_to_type[i + 1];
 
-    ++b->n_occurrences[c1no_act][c2no_act];
-    b->avg_execution_time[c1no_act][c2no_act] /=
-        b->n_occurrences[c1no_act][c2no_act];
+    BigramEntry *e = BT_get(b, c1no_act, c2no_act);
+    ++e->n_occurrences;
+    DIST_add(&e->latency, e->n_occurrences, t1 + t2);
 
-    if (c1no_act != c1no_typ || c2no_act != c2no_typ) {
-      ++b->n_misses[c1no_act][c2no_act];
+    const bool missed = c1no_act != c1no_typ || c2no_act != c2no_typ;
+    if (missed) {
+      ++e->n_misses;
     }
+    EWMA_add(&e->recent_occurrences, tick, 1.0f);
+    EWMA_add(&e->recent_misses, tick, missed);
   }
 }
 
-void dump_stats_bin(FILE *f, const MonoGramDataSummary *mds,
-                    const ConfMatrix *confusions, const BigramTable *bt) {
-  fwrite(confusions, sizeof(ConfMatrix), 1, f);
-  fwrite(mds, sizeof(MonoGramDataSummary), 1, f);
-  fwrite(bt, sizeof(BigramTable), 1, f);
+void BT_merge(BigramTable *dst, const BigramTable *src, uint32_t src_tick) {
+  for (uint32_t i = 0; i < src->cap; ++i) {
+    const BigramEntry *s = &src->entries[i];
+    if (s->key == 0) {
+      continue;
+    }
+    BigramEntry *d = BT_get(dst, BE_first(s), BE_second(s));
+    DIST_merge(&d->latency, d->n_occurrences, &s->latency, s->n_occurrences);
+    d->n_occurrences += s->n_occurrences;
+    d->n_misses += s->n_misses;
+    EWMA_merge(&d->recent_occurrences, s->recent_occurrences, src_tick);
+    EWMA_merge(&d->recent_misses, s->recent_misses, src_tick);
+  }
 }
 
 void dump_stats_csv(const MonoGramDataSummary *mds,
-                    const ConfMatrix *confusions, const BigramTable *bt) {
+                    const ConfMatrix *confusions, const BigramTable *bt,
+                    uint32_t tick) {
   FILE *conf_file = fopen("./confusions.csv", "w");
 
   fprintf(conf_file, "correct");
@@ -155,14 +302,51 @@ void dump_stats_csv(const MonoGramDataSummary *mds,
   }
   fclose(conf_file);
 
+  FILE *recent_file = fopen("./confusions_recent.csv", "w");
+  fprintf(recent_file, "correct");
+  for (int i = 0; i < N_CHARS; ++i) {
+    fprintf(recent_file, ",%i", i + 32);
+  }
+  fprintf(recent_file, "\n");
+  for (int i = 0; i < N_CHARS; ++i) {
+    fprintf(recent_file, "%i", i + 32);
+    for (int j = 0; j < N_CHARS; ++j) {
+      fprintf(recent_file, ",%f", EWMA_at(confusions->recent[i][j], tick));
+    }
+    fprintf(recent_file, "\n");
+  }
+  fclose(recent_file);
+
   FILE *mds_file = fopen("./mds.csv", "w");
-  fprintf(mds_file, "char,occurrences,misses,avg_time\n");
+  fprintf(mds_file, "char,occurrences,misses,avg_time,stddev,p50,p90,p99,"
+                    "recent_occurrences,recent_misses\n");
   for (int i = 0; i < N_CHARS; ++i) {
-    fprintf(mds_file, "%i,%ld,%ld,%f\n", i + 32, mds->n_occurrences[i],
-            mds->n_misses[i], mds->times[i]);
+    const Dist *d = &mds->latency[i];
+    fprintf(mds_file, "%i,%ld,%ld,%f,%f,%f,%f,%f,%f,%f\n", i + 32,
+            mds->n_occurrences[i], mds->n_misses[i], d->mean,
+            sqrt(DIST_variance(d, mds->n_occurrences[i])),
+            DIST_quantile(d, 0.5), DIST_quantile(d, 0.9),
+            DIST_quantile(d, 0.99), EWMA_at(mds->recent_occurrences[i], tick),
+            EWMA_at(mds->recent_misses[i], tick));
   }
   fclose(mds_file);
 
   FILE *bt_file = fopen("./bigramtable.csv", "w");
+  fprintf(bt_file, "first,second,occurrences,misses,avg_time,stddev,p50,p90,"
+                   "p99,recent_occurrences,recent_misses\n");
+  for (uint32_t i = 0; i < bt->cap; ++i) {
+    const BigramEntry *e = &bt->entries[i];
+    if (e->key != 0) {
+      fprintf(bt_file, "%i,%i,%ld,%ld,%f,%f,%f,%f,%f,%f,%f\n",
+              BE_first(e) + 32, BE_second(e) + 32, e->n_occurrences,
+              e->n_misses, e->latency.mean,
+              sqrt(DIST_variance(&e->latency, e->n_occurrences)),
+              DIST_quantile(&e->latency, 0.5),
+              DIST_quantile(&e->latency, 0.9),
+              DIST_quantile(&e->latency, 0.99),
+              EWMA_at(e->recent_occurrences, tick),
+              EWMA_at(e->recent_misses, tick));
+    }
+  }
   fclose(bt_file);
 }
@@ -3,7 +3,7 @@
 
 #include "stdint.h"
 #include "text.h"
-#include "stdint.h"
+#include "dist.h"
 #include "keys.h"
 
 #define STORAGE_NAME "typtr_data.dat"
@@ -11,41 +11,162 @@
 extern const char keys[N_CHARS];
 extern uint32_t *crc_table;
 
+// lessons after which recent counts have decayed to half
+#ifndef EWMA_HALF_LIFE
+#define EWMA_HALF_LIFE 50.0
+#endif
+
+/**
+ * Exponentially decayed count with lazy decay: value is exact at tick and
+ * only decayed when it is read or added to, so untouched cells cost nothing.
+ * Ticks are lesson sequence numbers.
+ */
+typedef struct {
+  float value;
+  uint32_t tick;
+} Ewma;
+
+/** decayed value of e at tick */
+float EWMA_at(Ewma e, uint32_t tick);
+
+/** add x at tick, which must not be older than e's tick */
+void EWMA_add(Ewma *e, uint32_t tick, float x);
+
 typedef struct {
   //          correct typed
   long matrix[N_CHARS][N_CHARS];
   long n_hits;
+  Ewma recent[N_CHARS][N_CHARS];
 } ConfMatrix;
 
 typedef struct {
-  float times[N_CHARS];
+  Dist latency[N_CHARS]; //< time to type the key
   long n_occurrences[N_CHARS];
   long n_misses[N_CHARS];
+  Ewma recent_occurrences[N_CHARS];
+  Ewma recent_misses[N_CHARS];
 } MonoGramDataSummary;
 
+// smallest capacity of a BigramTable
+#define BT_MIN_CAP 64
+// capacity that holds all N_CHARS * N_CHARS bigrams below the max load
+#define BT_MAX_CAP 16384
+
+/**
+ * Stats of a single bigram. Zeroed entries are free slots, so zero filled
+ * memory is an empty table.
+ */
 typedef struct {
-  float avg_execution_time[N_CHARS][N_CHARS];
-  long n_occurrences[N_CHARS][N_CHARS];
-  long n_misses[N_CHARS][N_CHARS];
-} BigramTable;
+  uint16_t key; //< first * N_CHARS + second + 1, 0 for free slots
+  long n_occurrences;
+  long n_misses;
+  Dist latency; //< time to type both keys
+  Ewma recent_occurrences;
+  Ewma recent_misses;
+} BigramEntry;
+
+typedef struct BigramTable BigramTable;
+
+/**
+ * Sparse bigram stats: an open addressing hash table (linear probing) over
+ * the bigrams that were actually typed. The same entry layout is used in
+ * memory and in the stats file.
+ */
+struct BigramTable {
+  BigramEntry *entries; //< cap slots
+  uint32_t cap;         //< power of two
+  uint32_t n;           //< used slots
 
-void update_conf_matrix(ConfMatrix *mat, Text *t);
+  /**
+   * Replaces entries by cap zeroed slots holding the bigrams of the table,
+   * see BT_rehash. NULL for tables from BT_new, which reallocate.
+   */
+  void (*grow)(BigramTable *bt, uint32_t cap, void *ctx);
+  void *grow_ctx;
+};
+
+/**
+ * @brief add the lesson t to the lifetime and recent confusions
+ *
+ * @param tick sequence number of the lesson
+ */
+void update_conf_matrix(ConfMatrix *mat, const Text *t, uint32_t tick);
 
 void print_conf_matrix(ConfMatrix *mat);
 
-void MDS_update(MonoGramDataSummary* mds, Text *t);
+void MDS_update(MonoGramDataSummary* mds, const Text *t, uint32_t tick);
 
 void print_mds(MonoGramDataSummary *mds);
 
-void dump_stats_bin(FILE *f, const MonoGramDataSummary *mds,
-                const ConfMatrix *confusions, const BigramTable *bt);
+/*
+ * Merging adds the stats of another user. Their recent counts are decayed to
+ * src_tick, the last lesson of that user, and added at tick 0. So merged
+ * recent counts compare the latest lessons of all users and have to be read
+ * at tick 0.
+ */
+
+/** @brief add the confusions of src to dst */
+void merge_conf_matrix(ConfMatrix *dst, const ConfMatrix *src,
+                       uint32_t src_tick);
+
+/** @brief add the monogram stats of src to dst */
+void MDS_merge(MonoGramDataSummary *dst, const MonoGramDataSummary *src,
+               uint32_t src_tick);
 
 // CRC for generating random seed
 void init_crc_table(void);
 void deinit_crc_table(void);
 uint32_t crc32(const char *bytes, long size);
 
-void BT_update(BigramTable *b, const Text *t);
+/**
+ * @brief empty heap allocated table, release with BT_free
+ */
+BigramTable BT_new(void);
+
+void BT_free(BigramTable *bt);
+
+/**
+ * @brief count the used slots of entries, e.g. after loading them
+ */
+uint32_t BT_count(const BigramEntry *entries, uint32_t cap);
+
+/**
+ * @brief insert all bigrams of bt into the zeroed table to with cap slots
+ */
+void BT_rehash(const BigramTable *bt, BigramEntry *to, uint32_t cap);
+
+/**
+ * @brief stats of a bigram, NULL if it was never typed
+ */
+BigramEntry *BT_find(const BigramTable *bt, int first, int second);
+
+/**
+ * @brief stats of a bigram, inserted as zero if it was never typed
+ */
+BigramEntry *BT_get(BigramTable *bt, int first, int second);
+
+/**
+ * @brief grow the table to hold n bigrams without growing on BT_get
+ */
+void BT_reserve(BigramTable *bt, uint32_t n);
+
+static inline int BE_first(const BigramEntry *e) {
+  return (e->key - 1) / N_CHARS;
+}
+
+static inline int BE_second(const BigramEntry *e) {
+  return (e->key - 1) % N_CHARS;
+}
+
+void BT_update(BigramTable *b, const Text *t, uint32_t tick);
+
+/** @brief add all bigrams of src to dst */
+void BT_merge(BigramTable *dst, const BigramTable *src, uint32_t src_tick);
 
-void dump_stats_csv(const MonoGramDataSummary* mds, const ConfMatrix *confusions, const BigramTable *bt);
+/**
+ * @brief write all stats as csv files, recent counts decayed to tick
+ */
+void dump_stats_csv(const MonoGramDataSummary *mds,
+                    const ConfMatrix *confusions, const BigramTable *bt,
+                    uint32_t tick);
 #endif // STATS_H
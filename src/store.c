@@ -0,0 +1,851 @@
+#include "store.h"
+
+#include "errno.h"
+#include "fcntl.h"
+#include "keys.h"
+#include "limits.h"
+#include "math.h"
+#include "stddef.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "thread_util.h"
+#include "unistd.h"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t n_entries;
+  uint64_t seq;
+  uint32_t crc; //< crc32 of the entries
+  uint32_t pad;
+} JournalRecord;
+
+typedef enum {
+  JF_CONF = 0,
+  JF_CONF_HITS,
+  JF_MDS_TIME,
+  JF_MDS_OCC,
+  JF_MDS_MISS,
+  JF_BT_TIME,
+  JF_BT_OCC,
+  JF_BT_MISS,
+  JF_MDS_M2,
+  JF_MDS_HIST,
+  JF_BT_M2,
+  JF_BT_HIST,
+  JF_CONF_EWMA,
+  JF_MDS_EWMA_OCC,
+  JF_MDS_EWMA_MISS,
+  JF_BT_EWMA_OCC,
+  JF_BT_EWMA_MISS,
+} JournalField;
+
+// new value of a single cell
+struct JournalEntry {
+  uint16_t field;
+  uint16_t cell;
+  uint32_t aux; //< histogram bucket or tick of a recent count, else 0
+  union {
+    int64_t i;
+    double f;
+  } value;
+};
+
+// every cell of every table at most once
+#define MAX_ENTRIES                                                            \
+  (2 * N_CHARS * N_CHARS + 1 + N_CHARS * (6 + DIST_BUCKETS) +                 \
+   N_CHARS * N_CHARS * (6 + DIST_BUCKETS))
+
+static void exit_err_store(const char *msg, const char *fname) {
+  fprintf(stderr, "%s '%s': %s\nExiting...\n", msg, fname, strerror(errno));
+  exit(EXIT_FAILURE);
+}
+
+#define STATS_FIXED_SIZE (sizeof(StatsFile) - offsetof(StatsFile, confusions))
+
+static size_t stats_size(uint32_t bt_cap) {
+  return sizeof(StatsFile) + bt_cap * sizeof(BigramEntry);
+}
+
+// the bigram entries follow the fixed part
+static BigramEntry *stats_entries(StatsFile *file) {
+  return (BigramEntry *)(file + 1);
+}
+
+static uint32_t fixed_crc(const StatsFile *file) {
+  return crc32((const char *)&file->confusions, (long)STATS_FIXED_SIZE);
+}
+
+static uint32_t entries_crc(const BigramTable *bt) {
+  return crc32((const char *)bt->entries,
+               (long)(bt->cap * sizeof(BigramEntry)));
+}
+
+/**
+ * @brief read and validate the header of the stats file
+ *
+ * @return false if the file is a headerless stats dump
+ */
+static bool read_header(int fd, const char *fname, StatsHeader *header) {
+  if (pread(fd, header, sizeof(*header), 0) != sizeof(*header) ||
+      memcmp(header->magic, STORE_MAGIC, sizeof(header->magic)) != 0) {
+    return false;
+  }
+  if (header->version != STORE_VERSION) {
+    fprintf(stderr, "Unsupported storage file version %u in '%s'\n",
+            header->version, fname);
+    exit(EXIT_FAILURE);
+  }
+  if (header->byte_order != STORE_BYTE_ORDER ||
+      header->alphabet_size != N_CHARS) {
+    fprintf(stderr,
+            "Storage file '%s' was written with a different byte order or "
+            "alphabet\nExiting...\n",
+            fname);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  const uint32_t cap = header->bt_cap;
+  if (fstat(fd, &st) != 0 || cap < BT_MIN_CAP || cap > BT_MAX_CAP ||
+      (cap & (cap - 1)) != 0 || (unsigned long)st.st_size != stats_size(cap) ||
+      header->data_size != stats_size(cap) - sizeof(StatsHeader)) {
+    fprintf(stderr, "Storage file '%s' has an invalid size\nExiting...\n",
+            fname);
+    exit(EXIT_FAILURE);
+  }
+  return true;
+}
+
+// without a clean shutdown the crcs are stale, the journal is the authority
+static void check_crcs(const StatsFile *file, const BigramTable *bt,
+                       const char *fname) {
+  if ((file->header.flags & STORE_FLAG_CLEAN) &&
+      (fixed_crc(file) != file->header.crc ||
+       entries_crc(bt) != file->header.bt_crc)) {
+    fprintf(stderr, "Storage file '%s' is corrupted\nExiting...\n", fname);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void grow_mapped(BigramTable *bt, uint32_t cap, void *ctx);
+
+/**
+ * @brief map the stats file at s->file, the start of the reserved range
+ *
+ * @return false if there is no file or it is a headerless stats dump
+ */
+static bool map_stats_file(StatsStore *s) {
+  errno = 0;
+  const int fd = open(STORAGE_NAME, O_RDWR);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      exit_err_store("Error opening storage file", STORAGE_NAME);
+    }
+    errno = 0;
+    return false;
+  }
+
+  StatsHeader header;
+  if (!read_header(fd, STORAGE_NAME, &header)) {
+    close(fd);
+    errno = 0;
+    return false;
+  }
+
+  s->map_size = stats_size(header.bt_cap);
+  void *map = mmap(s->file, s->map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_FIXED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    exit_err_store("Error mapping storage file", STORAGE_NAME);
+  }
+
+  s->bt_table = (BigramTable){
+      .entries = stats_entries(s->file),
+      .cap = header.bt_cap,
+      .n = BT_count(stats_entries(s->file), header.bt_cap),
+      .grow = &grow_mapped,
+      .grow_ctx = s,
+  };
+  check_crcs(s->file, &s->bt_table, STORAGE_NAME);
+
+  // the file is modified from here on
+  s->file->header.flags &= ~STORE_FLAG_CLEAN;
+  if (msync(s->file, sizeof(StatsHeader), MS_SYNC) != 0) {
+    exit_err_store("Error syncing storage file", STORAGE_NAME);
+  }
+  return true;
+}
+
+/**
+ * @brief read the stats file fname into memory
+ *
+ * @return false if there is no file or it is a headerless stats dump
+ */
+static bool read_stats_file(StatsStore *s, const char *fname) {
+  errno = 0;
+  const int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      exit_err_store("Error opening storage file", fname);
+    }
+    errno = 0;
+    return false;
+  }
+
+  StatsHeader header;
+  if (!read_header(fd, fname, &header)) {
+    close(fd);
+    errno = 0;
+    return false;
+  }
+
+  s->file = malloc(sizeof(StatsFile));
+  BigramEntry *entries = malloc(header.bt_cap * sizeof(BigramEntry));
+  const size_t entries_size = header.bt_cap * sizeof(BigramEntry);
+  if (pread(fd, s->file, sizeof(StatsFile), 0) != sizeof(StatsFile) ||
+      pread(fd, entries, entries_size, sizeof(StatsFile)) !=
+          (ssize_t)entries_size) {
+    exit_err_store("Error reading storage file", fname);
+  }
+  close(fd);
+
+  s->bt_table = (BigramTable){
+      .entries = entries,
+      .cap = header.bt_cap,
+      .n = BT_count(entries, header.bt_cap),
+  };
+  check_crcs(s->file, &s->bt_table, fname);
+  return true;
+}
+
+// confusions of headerless stats dumps
+typedef struct {
+  long matrix[N_CHARS][N_CHARS];
+  long n_hits;
+} LegacyConfMatrix;
+
+// monogram stats of headerless stats dumps
+typedef struct {
+  float times[N_CHARS];
+  long n_occurrences[N_CHARS];
+  long n_misses[N_CHARS];
+} LegacyMonoGramDataSummary;
+
+// dense bigram stats of headerless stats dumps
+typedef struct {
+  float avg_execution_time[N_CHARS][N_CHARS];
+  long n_occurrences[N_CHARS][N_CHARS];
+  long n_misses[N_CHARS][N_CHARS];
+} DenseBigramTable;
+
+// latency distributions start out with only the mean
+static void set_legacy_bigram(BigramTable *bt, int first, int second,
+                              float avg_time, long n_occurrences,
+                              long n_misses) {
+  BigramEntry *e = BT_get(bt, first, second);
+  e->n_occurrences = n_occurrences;
+  e->n_misses = n_misses;
+  // a NaN average would stick forever
+  e->latency.mean = isnan(avg_time) ? 0.0 : avg_time;
+}
+
+/**
+ * @brief recent counts for stats dumps without them
+ *
+ * Dumps don't count their lessons, so the recent counts start out as the
+ * lifetime ones and decay from the first lesson on.
+ */
+static void seed_recent(StatsFile *file, BigramTable *bt) {
+  for (int i = 0; i < N_CHARS; ++i) {
+    for (int j = 0; j < N_CHARS; ++j) {
+      file->confusions.recent[i][j] =
+          (Ewma){(float)file->confusions.matrix[i][j], 0};
+    }
+    file->mds.recent_occurrences[i] =
+        (Ewma){(float)file->mds.n_occurrences[i], 0};
+    file->mds.recent_misses[i] = (Ewma){(float)file->mds.n_misses[i], 0};
+  }
+  for (uint32_t i = 0; i < bt->cap; ++i) {
+    BigramEntry *e = &bt->entries[i];
+    e->recent_occurrences = (Ewma){(float)e->n_occurrences, 0};
+    e->recent_misses = (Ewma){(float)e->n_misses, 0};
+  }
+}
+
+static void read_legacy_failed(const char *fname) {
+  fprintf(stderr, "Error reading storage file '%s'\nExiting...\n", fname);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief read a headerless stats dump from fname into memory
+ *
+ * No file gives empty stats. Latency distributions only have a mean, recent
+ * counts are seeded from the lifetime ones.
+ */
+static StatsFile *read_legacy_stats(const char *fname, BigramTable *bt) {
+  StatsFile *file = calloc(1, sizeof(StatsFile));
+  *bt = BT_new();
+
+  errno = 0;
+  FILE *f = fopen(fname, "r");
+  if (f == NULL) {
+    if (errno != ENOENT) {
+      exit_err_store("Error opening storage file", fname);
+    }
+    errno = 0;
+    return file;
+  }
+
+  LegacyConfMatrix confusions;
+  if (fread(&confusions, sizeof(confusions), 1, f) != 1) {
+    read_legacy_failed(fname);
+  }
+  memcpy(file->confusions.matrix, confusions.matrix,
+         sizeof(confusions.matrix));
+  file->confusions.n_hits = confusions.n_hits;
+
+  LegacyMonoGramDataSummary mds;
+  if (fread(&mds, sizeof(mds), 1, f) != 1) {
+    read_legacy_failed(fname);
+  }
+  for (int c = 0; c < N_CHARS; ++c) {
+    file->mds.n_occurrences[c] = mds.n_occurrences[c];
+    file->mds.n_misses[c] = mds.n_misses[c];
+    // keys that were never typed had a NaN average
+    file->mds.latency[c].mean =
+        mds.n_occurrences[c] > 0 && !isnan(mds.times[c]) ? mds.times[c] : 0.0;
+  }
+
+  DenseBigramTable *dense = malloc(sizeof(DenseBigramTable));
+  if (fread(dense, sizeof(DenseBigramTable), 1, f) != 1) {
+    read_legacy_failed(fname);
+  }
+  for (int first = 0; first < N_CHARS; ++first) {
+    for (int second = 0; second < N_CHARS; ++second) {
+      if (dense->n_occurrences[first][second] != 0) {
+        set_legacy_bigram(bt, first, second,
+                          dense->avg_execution_time[first][second],
+                          dense->n_occurrences[first][second],
+                          dense->n_misses[first][second]);
+      }
+    }
+  }
+  free(dense);
+  fclose(f);
+  seed_recent(file, bt);
+  errno = 0;
+  return file;
+}
+
+// atomically replace the stats file with file and the entries of bt
+static void write_stats_file(const StatsFile *file, const BigramTable *bt) {
+  StatsHeader header = file->header;
+  memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+  header.version = STORE_VERSION;
+  header.byte_order = STORE_BYTE_ORDER;
+  header.alphabet_size = N_CHARS;
+  header.flags = STORE_FLAG_CLEAN;
+  header.crc = fixed_crc(file);
+  header.bt_crc = entries_crc(bt);
+  header.bt_cap = bt->cap;
+  header.data_size = stats_size(bt->cap) - sizeof(StatsHeader);
+
+  errno = 0;
+  FILE *f = fopen(STORAGE_NAME ".tmp", "w");
+  if (f == NULL) {
+    exit_err_store("Error creating storage file", STORAGE_NAME ".tmp");
+  }
+  const bool ok =
+      fwrite(&header, sizeof(header), 1, f) == 1 &&
+      fwrite(&file->confusions, STATS_FIXED_SIZE, 1, f) == 1 &&
+      fwrite(bt->entries, sizeof(BigramEntry), bt->cap, f) == bt->cap &&
+      fflush(f) == 0 && fsync(fileno(f)) == 0;
+  if (fclose(f) != 0 || !ok ||
+      rename(STORAGE_NAME ".tmp", STORAGE_NAME) != 0) {
+    exit_err_store("Error writing storage file", STORAGE_NAME);
+  }
+}
+
+static void SS_join(StatsStore *s) {
+  if (s->compacting) {
+    pthread_join(s->compactor, NULL);
+    s->compacting = false;
+  }
+}
+
+/**
+ * @brief grow the mapped table by rewriting the file and mapping it in place
+ *
+ * The rewritten file is marked clean, so it must only hold whole records.
+ * apply_record reserves the room of a record before applying it.
+ */
+static void grow_mapped(BigramTable *bt, uint32_t cap, void *ctx) {
+  StatsStore *s = ctx;
+  SS_join(s);
+
+  BigramTable grown = {
+      .entries = calloc(cap, sizeof(BigramEntry)),
+      .cap = cap,
+      .n = bt->n,
+  };
+  BT_rehash(bt, grown.entries, cap);
+  write_stats_file(s->file, &grown);
+  BT_free(&grown);
+
+  if (!map_stats_file(s)) {
+    exit_err_store("Error mapping storage file", STORAGE_NAME);
+  }
+}
+
+static bool is_bigram_field(uint16_t field) {
+  return field == JF_BT_TIME || field == JF_BT_OCC || field == JF_BT_MISS ||
+         field == JF_BT_M2 || field == JF_BT_HIST || field == JF_BT_EWMA_OCC ||
+         field == JF_BT_EWMA_MISS;
+}
+
+static bool apply_entry(StatsStore *s, const JournalEntry *e) {
+  const int n_cells =
+      e->field == JF_CONF_HITS ? 1
+      : (e->field == JF_MDS_TIME || e->field == JF_MDS_OCC ||
+         e->field == JF_MDS_MISS || e->field == JF_MDS_M2 ||
+         e->field == JF_MDS_HIST || e->field == JF_MDS_EWMA_OCC ||
+         e->field == JF_MDS_EWMA_MISS)
+          ? N_CHARS
+          : N_CHARS * N_CHARS;
+  const bool hist = e->field == JF_MDS_HIST || e->field == JF_BT_HIST;
+  if (e->cell >= n_cells || (hist && e->aux >= DIST_BUCKETS)) {
+    return false;
+  }
+  const Ewma recent = {(float)e->value.f, e->aux};
+  const int first = e->cell / N_CHARS;
+  const int second = e->cell % N_CHARS;
+
+  switch ((JournalField)e->field) {
+  case JF_CONF:
+    s->confusions->matrix[first][second] = e->value.i;
+    break;
+  case JF_CONF_HITS:
+    s->confusions->n_hits = e->value.i;
+    break;
+  case JF_CONF_EWMA:
+    s->confusions->recent[first][second] = recent;
+    break;
+  case JF_MDS_TIME:
+    s->mds->latency[e->cell].mean = e->value.f;
+    break;
+  case JF_MDS_M2:
+    s->mds->latency[e->cell].m2 = e->value.f;
+    break;
+  case JF_MDS_HIST:
+    s->mds->latency[e->cell].hist[e->aux] = (uint32_t)e->value.i;
+    break;
+  case JF_MDS_OCC:
+    s->mds->n_occurrences[e->cell] = e->value.i;
+    break;
+  case JF_MDS_MISS:
+    s->mds->n_misses[e->cell] = e->value.i;
+    break;
+  case JF_MDS_EWMA_OCC:
+    s->mds->recent_occurrences[e->cell] = recent;
+    break;
+  case JF_MDS_EWMA_MISS:
+    s->mds->recent_misses[e->cell] = recent;
+    break;
+  case JF_BT_TIME:
+    BT_get(s->bt, first, second)->latency.mean = e->value.f;
+    break;
+  case JF_BT_M2:
+    BT_get(s->bt, first, second)->latency.m2 = e->value.f;
+    break;
+  case JF_BT_HIST:
+    BT_get(s->bt, first, second)->latency.hist[e->aux] =
+        (uint32_t)e->value.i;
+    break;
+  case JF_BT_OCC:
+    BT_get(s->bt, first, second)->n_occurrences = e->value.i;
+    break;
+  case JF_BT_MISS:
+    BT_get(s->bt, first, second)->n_misses = e->value.i;
+    break;
+  case JF_BT_EWMA_OCC:
+    BT_get(s->bt, first, second)->recent_occurrences = recent;
+    break;
+  case JF_BT_EWMA_MISS:
+    BT_get(s->bt, first, second)->recent_misses = recent;
+    break;
+  default:
+    return false;
+  }
+  return true;
+}
+
+// the same for replayed records and the lessons of this session
+static void apply_record(StatsStore *s, const JournalEntry *entries,
+                         uint32_t n) {
+  // grow before the first value changes, not in the middle of the record
+  bool counted[N_CHARS * N_CHARS] = {false};
+  uint32_t n_new = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    const JournalEntry *e = &entries[i];
+    if (is_bigram_field(e->field) && e->cell < N_CHARS * N_CHARS &&
+        !counted[e->cell]) {
+      counted[e->cell] = true;
+      n_new += BT_find(s->bt, e->cell / N_CHARS, e->cell % N_CHARS) == NULL;
+    }
+  }
+  BT_reserve(s->bt, s->bt->n + n_new);
+
+  for (uint32_t i = 0; i < n; ++i) {
+    apply_entry(s, &entries[i]);
+  }
+}
+
+/**
+ * @brief apply all records newer than the stats from a journal file
+ *
+ * @return offset after the last intact record, a torn record from a crash
+ *         ends the replay
+ */
+static long replay_journal(StatsStore *s, const char *fname) {
+  errno = 0;
+  FILE *f = fopen(fname, "r");
+  if (f == NULL) {
+    if (errno != ENOENT) {
+      exit_err_store("Error opening journal", fname);
+    }
+    errno = 0;
+    return 0;
+  }
+
+  JournalEntry *entries = NULL;
+  uint32_t entries_cap = 0;
+  long valid_end = 0;
+  JournalRecord rec;
+  while (fread(&rec, sizeof(rec), 1, f) == 1) {
+    if (rec.magic != STORE_JOURNAL_MAGIC || rec.n_entries > MAX_ENTRIES) {
+      break;
+    }
+    if (rec.n_entries > entries_cap) {
+      entries_cap = rec.n_entries;
+      entries = realloc(entries, entries_cap * sizeof(JournalEntry));
+    }
+    if (fread(entries, sizeof(JournalEntry), rec.n_entries, f) !=
+            rec.n_entries ||
+        crc32((const char *)entries,
+              (long)(rec.n_entries * sizeof(JournalEntry))) != rec.crc) {
+      break;
+    }
+
+    if (rec.seq > s->seq) {
+      apply_record(s, entries, rec.n_entries);
+      s->seq = rec.seq;
+    }
+    valid_end = ftell(f);
+  }
+
+  free(entries);
+  fclose(f);
+  errno = 0;
+  return valid_end;
+}
+
+// point the views into the loaded stats and replay the journals of fname
+static long SS_load_journals(StatsStore *s, const char *fname) {
+  s->confusions = &s->file->confusions;
+  s->mds = &s->file->mds;
+  s->bt = &s->bt_table;
+  s->seq = s->file->header.seq;
+
+  // a leftover old journal means a checkpoint did not finish
+  char journal[PATH_MAX];
+  snprintf(journal, sizeof(journal), "%s.journal.old", fname);
+  replay_journal(s, journal);
+  snprintf(journal, sizeof(journal), "%s.journal", fname);
+  return replay_journal(s, journal);
+}
+
+void SS_read(StatsStore *s, const char *fname) {
+  *s = (StatsStore){0};
+  if (!read_stats_file(s, fname)) {
+    s->file = read_legacy_stats(fname, &s->bt_table);
+  }
+  SS_load_journals(s, fname);
+}
+
+void SS_open(StatsStore *s, bool writable) {
+  if (!writable) {
+    SS_read(s, STORAGE_NAME);
+    return;
+  }
+  *s = (StatsStore){.mapped = true};
+
+  s->file = mmap(NULL, STORE_MAX_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1, 0);
+  if (s->file == MAP_FAILED) {
+    exit_err_store("Error reserving memory for", STORAGE_NAME);
+  }
+  if (!map_stats_file(s)) {
+    BigramTable bt;
+    StatsFile *contents = read_legacy_stats(STORAGE_NAME, &bt);
+    write_stats_file(contents, &bt);
+    BT_free(&bt);
+    free(contents);
+    if (!map_stats_file(s)) {
+      exit_err_store("Error mapping storage file", STORAGE_NAME);
+    }
+  }
+  const long journal_end = SS_load_journals(s, STORAGE_NAME);
+
+  // drop a torn record at the end, so new records stay readable
+  if (truncate(JOURNAL_NAME, journal_end) != 0 && errno != ENOENT) {
+    exit_err_store("Error truncating journal", JOURNAL_NAME);
+  }
+  errno = 0;
+  s->journal = fopen(JOURNAL_NAME, "a");
+  if (s->journal == NULL) {
+    exit_err_store("Error opening journal", JOURNAL_NAME);
+  }
+  s->journal_size = journal_end;
+
+  s->next_confusions = malloc(sizeof(ConfMatrix));
+  s->next_mds = malloc(sizeof(MonoGramDataSummary));
+  s->next_bt = BT_new();
+}
+
+static void *checkpoint(void *arg) {
+  StatsStore *s = arg;
+
+  // the header may only claim lessons whose cells are on disk
+  if (msync(s->file, s->map_size, MS_SYNC) != 0) {
+    return NULL;
+  }
+  s->file->header.seq = s->checkpoint_seq;
+  if (msync(s->file, sizeof(StatsHeader), MS_SYNC) == 0) {
+    unlink(JOURNAL_OLD_NAME);
+  }
+  return NULL;
+}
+
+static void SS_compact(StatsStore *s) {
+  SS_join(s);
+
+  // rotate, unless a failed checkpoint left an old journal behind. Then the
+  // next checkpoint covers both journals and the current one keeps growing.
+  if (access(JOURNAL_OLD_NAME, F_OK) != 0) {
+    fclose(s->journal);
+    const bool rotated = rename(JOURNAL_NAME, JOURNAL_OLD_NAME) == 0;
+    s->journal = fopen(JOURNAL_NAME, "a");
+    if (s->journal == NULL) {
+      exit_err_store("Error opening journal", JOURNAL_NAME);
+    }
+    if (rotated) {
+      s->journal_size = 0;
+    }
+  }
+  errno = 0;
+
+  // lessons after checkpoint_seq may reach the disk too, the new journal
+  // has their records
+  s->checkpoint_seq = s->seq;
+  if (start_worker(&s->compactor, &checkpoint, s) == 0) {
+    s->compacting = true;
+  } else {
+    checkpoint(s);
+  }
+}
+
+static void add_entry(JournalEntry *entries, uint32_t *n, JournalField field,
+                      int cell, int64_t i, double f) {
+  JournalEntry *e = &entries[(*n)++];
+  *e = (JournalEntry){.field = (uint16_t)field, .cell = (uint16_t)cell};
+  if (field == JF_MDS_TIME || field == JF_BT_TIME || field == JF_MDS_M2 ||
+      field == JF_BT_M2 || field >= JF_CONF_EWMA) {
+    e->value.f = f;
+  } else {
+    e->value.i = i;
+  }
+}
+
+// mean, spread and the histogram buckets set in touched
+static void add_dist(JournalEntry *entries, uint32_t *n, bool bigram, int cell,
+                     const Dist *d, uint32_t touched) {
+  add_entry(entries, n, bigram ? JF_BT_TIME : JF_MDS_TIME, cell, 0, d->mean);
+  add_entry(entries, n, bigram ? JF_BT_M2 : JF_MDS_M2, cell, 0, d->m2);
+  for (; touched; touched &= touched - 1) {
+    const int bucket = __builtin_ctz(touched);
+    add_entry(entries, n, bigram ? JF_BT_HIST : JF_MDS_HIST, cell,
+              d->hist[bucket], 0.0);
+    entries[*n - 1].aux = (uint32_t)bucket;
+  }
+}
+
+static void add_ewma(JournalEntry *entries, uint32_t *n, JournalField field,
+                     int cell, Ewma e) {
+  add_entry(entries, n, field, cell, 0, e.value);
+  entries[*n - 1].aux = e.tick;
+}
+
+// copy the cells t touches, so the lesson can be computed without changing
+// the stats
+static void copy_touched(StatsStore *s, const Text *t) {
+  memcpy(s->next_confusions, s->confusions, sizeof(ConfMatrix));
+  memcpy(s->next_mds, s->mds, sizeof(MonoGramDataSummary));
+
+  BigramTable *next = &s->next_bt;
+  memset(next->entries, 0, next->cap * sizeof(BigramEntry));
+  next->n = 0;
+  for (long i = 0; i < t->n_chars - 1; ++i) {
+    const int first = char_idx(t->chars[i]);
+    const int second = char_idx(t->chars[i + 1]);
+    const BigramEntry *e = BT_find(s->bt, first, second);
+    if (e != NULL) {
+      *BT_get(next, first, second) = *e;
+    }
+  }
+}
+
+void SS_log_lesson(StatsStore *s, const Text *t, uint32_t tick) {
+  copy_touched(s, t);
+  const ConfMatrix *conf = s->next_confusions;
+  const MonoGramDataSummary *mds = s->next_mds;
+  const BigramTable *bt = &s->next_bt;
+  update_conf_matrix(s->next_confusions, t, tick);
+  MDS_update(s->next_mds, t, tick);
+  BT_update(&s->next_bt, t, tick);
+
+  // only the table cells typed in this lesson are written, each once. The
+  // masks hold the histogram buckets that changed.
+  bool seen_conf[N_CHARS * N_CHARS] = {0};
+  uint32_t mds_buckets[N_CHARS] = {0};
+  uint32_t bt_buckets[N_CHARS * N_CHARS] = {0};
+  for (int i = 0; i < t->n_chars; ++i) {
+    if (!is_key(t->chars[i])) {
+      continue;
+    }
+    const int c = char_idx(t->chars[i]);
+    if (is_key(t->typedchars[i])) {
+      seen_conf[c * N_CHARS + char_idx(t->typedchars[i])] = true;
+    }
+    mds_buckets[c] |= 1u << DIST_bucket(t->time_to_type[i]);
+    if (i + 1 < t->n_chars && is_key(t->chars[i + 1])) {
+      const double time = t->time_to_type[i] + t->time_to_type[i + 1];
+      bt_buckets[c * N_CHARS + char_idx(t->chars[i + 1])] |=
+          1u << DIST_bucket(time);
+    }
+  }
+
+  // per key: 2 confusion, 6 monogram and 6 bigram fields, two buckets
+  JournalEntry *entries = realloc(
+      s->pending, (16 * (unsigned long)t->n_chars + 1) * sizeof(JournalEntry));
+  uint32_t n = 0;
+
+  add_entry(entries, &n, JF_CONF_HITS, 0, conf->n_hits, 0.0);
+  for (int i = 0; i < t->n_chars; ++i) {
+    if (!is_key(t->chars[i])) {
+      continue;
+    }
+    const int c = char_idx(t->chars[i]);
+
+    if (is_key(t->typedchars[i])) {
+      const int typed = char_idx(t->typedchars[i]);
+      const int conf_cell = c * N_CHARS + typed;
+      if (seen_conf[conf_cell]) {
+        seen_conf[conf_cell] = false;
+        add_entry(entries, &n, JF_CONF, conf_cell, conf->matrix[c][typed],
+                  0.0);
+        add_ewma(entries, &n, JF_CONF_EWMA, conf_cell,
+                 conf->recent[c][typed]);
+      }
+    }
+
+    if (mds_buckets[c]) {
+      add_entry(entries, &n, JF_MDS_OCC, c, mds->n_occurrences[c], 0.0);
+      add_entry(entries, &n, JF_MDS_MISS, c, mds->n_misses[c], 0.0);
+      add_ewma(entries, &n, JF_MDS_EWMA_OCC, c, mds->recent_occurrences[c]);
+      add_ewma(entries, &n, JF_MDS_EWMA_MISS, c, mds->recent_misses[c]);
+      add_dist(entries, &n, false, c, &mds->latency[c], mds_buckets[c]);
+      mds_buckets[c] = 0;
+    }
+
+    if (i + 1 < t->n_chars && is_key(t->chars[i + 1])) {
+      const int next = char_idx(t->chars[i + 1]);
+      const int bt_cell = c * N_CHARS + next;
+      if (bt_buckets[bt_cell]) {
+        const BigramEntry *e = BT_find(bt, c, next);
+        add_entry(entries, &n, JF_BT_OCC, bt_cell, e->n_occurrences, 0.0);
+        add_entry(entries, &n, JF_BT_MISS, bt_cell, e->n_misses, 0.0);
+        add_ewma(entries, &n, JF_BT_EWMA_OCC, bt_cell, e->recent_occurrences);
+        add_ewma(entries, &n, JF_BT_EWMA_MISS, bt_cell, e->recent_misses);
+        add_dist(entries, &n, true, bt_cell, &e->latency, bt_buckets[bt_cell]);
+        bt_buckets[bt_cell] = 0;
+      }
+    }
+  }
+  s->pending = entries;
+  s->n_pending = n;
+
+  const JournalRecord rec = {
+      .magic = STORE_JOURNAL_MAGIC,
+      .n_entries = n,
+      .seq = s->seq + 1,
+      .crc = crc32((const char *)entries, (long)(n * sizeof(JournalEntry))),
+  };
+  const bool ok = fwrite(&rec, sizeof(rec), 1, s->journal) == 1 &&
+                  fwrite(entries, sizeof(JournalEntry), n, s->journal) == n &&
+                  fflush(s->journal) == 0 && fsync(fileno(s->journal)) == 0;
+  if (!ok) {
+    exit_err_store("Error appending to journal", JOURNAL_NAME);
+  }
+  s->journal_size += (long)(sizeof(rec) + n * sizeof(JournalEntry));
+}
+
+void SS_apply_lesson(StatsStore *s) {
+  apply_record(s, s->pending, s->n_pending);
+  s->n_pending = 0;
+  ++s->seq;
+  if (s->journal_size >= STORE_COMPACT_BYTES) {
+    SS_compact(s);
+  }
+}
+
+void SS_record_lesson(StatsStore *s, const Text *t, uint32_t tick) {
+  SS_log_lesson(s, t, tick);
+  SS_apply_lesson(s);
+}
+
+void SS_close(StatsStore *s) {
+  SS_join(s);
+
+  if (!s->mapped) {
+    free(s->file);
+    BT_free(&s->bt_table);
+    *s = (StatsStore){0};
+    return;
+  }
+
+  free(s->next_confusions);
+  free(s->next_mds);
+  BT_free(&s->next_bt);
+  free(s->pending);
+
+  if (s->journal) {
+    fclose(s->journal);
+    // final checkpoint, the journals are not needed after a clean shutdown
+    if (msync(s->file, s->map_size, MS_SYNC) == 0) {
+      s->file->header.seq = s->seq;
+      s->file->header.crc = fixed_crc(s->file);
+      s->file->header.bt_crc = entries_crc(&s->bt_table);
+      s->file->header.flags |= STORE_FLAG_CLEAN;
+      if (msync(s->file, sizeof(StatsHeader), MS_SYNC) == 0) {
+        unlink(JOURNAL_NAME);
+        unlink(JOURNAL_OLD_NAME);
+      }
+    }
+  }
+  munmap(s->file, STORE_MAX_SIZE);
+  *s = (StatsStore){0};
+}
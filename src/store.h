@@ -0,0 +1,142 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include "pthread.h"
+#include "stats.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "stdio.h"
+
+#define JOURNAL_NAME STORAGE_NAME ".journal"
+#define JOURNAL_OLD_NAME STORAGE_NAME ".journal.old"
+#define STORE_MAGIC "TYPS"
+#define STORE_VERSION 1
+#define STORE_BYTE_ORDER 0x01020304u
+#define STORE_JOURNAL_MAGIC 0x4e524a54u // "TJRN"
+// checkpoint the mapped stats once the journal grows past this
+#define STORE_COMPACT_BYTES (256l * 1024l)
+
+// the file was checkpointed on close, crc is valid
+#define STORE_FLAG_CLEAN 0x1u
+
+/**
+ * On-disk header of the stats file. Integers are stored in host byte order,
+ * byte_order detects files from machines with a different one.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t alphabet_size; //< N_CHARS at write time
+  uint32_t flags;
+  uint32_t crc;       //< crc32 of confusions and mds
+  uint32_t bt_crc;    //< crc32 of the bigram entries
+  uint32_t bt_cap;    //< number of bigram entries
+  uint64_t seq;       //< last lesson that is guaranteed to be on disk
+  uint64_t data_size; //< bytes after the header
+} StatsHeader;
+
+/**
+ * Fixed size part of the stats file. It is followed by the bt_cap slots of
+ * the sparse BigramTable, so the file grows with the number of bigrams that
+ * were typed.
+ */
+typedef struct {
+  StatsHeader header;
+  ConfMatrix confusions;
+  MonoGramDataSummary mds;
+} StatsFile;
+
+// address space reserved for the mapping, so growing keeps it in place
+#define STORE_MAX_SIZE (sizeof(StatsFile) + BT_MAX_CAP * sizeof(BigramEntry))
+
+typedef struct JournalEntry JournalEntry;
+
+/**
+ * Persistent stats: a MAP_SHARED stats file that is updated in place, plus
+ * an append-only journal of per-lesson deltas.
+ *
+ * The stats pointers point into the mapping, so updating them updates the
+ * file and the page cache writes it back. When the bigram table has to grow,
+ * the file is rewritten with the larger table and mapped again at the same
+ * address. As write-back can happen at any time and in any order, every
+ * lesson is first written ahead to the journal as one record holding the new
+ * values of the cells it touches, numbered by a sequence number. Only after
+ * the record is synced are the values applied to the mapping. A checkpoint
+ * syncs the mapping on a background thread and only then stores its
+ * sequence number in the header, so loading is mapping + replay of all
+ * newer records. A crash at any point leaves a loadable state.
+ *
+ * Headerless stats dumps are converted when opened writable.
+ */
+typedef struct {
+  ConfMatrix *confusions;
+  MonoGramDataSummary *mds;
+  BigramTable *bt;
+
+  StatsFile *file;
+  BigramTable bt_table;
+  bool mapped; //< false if the stats were read into memory
+  size_t map_size;
+
+  uint64_t seq; //< sequence number of the last lesson in the stats
+  uint64_t checkpoint_seq;
+  FILE *journal;
+  long journal_size;
+
+  pthread_t compactor;
+  bool compacting;
+
+  // the next lesson is computed on copies of the cells it touches
+  ConfMatrix *next_confusions;
+  MonoGramDataSummary *next_mds;
+  BigramTable next_bt;
+  JournalEntry *pending; //< logged but not yet applied
+  uint32_t n_pending;
+} StatsStore;
+
+/**
+ * @brief map stats file and replay the journals
+ *
+ * s must stay at the same address until SS_close.
+ *
+ * @param writable update the file in place and open the journal for
+ *                 appending lessons. Otherwise the stats are read into
+ *                 memory.
+ */
+void SS_open(StatsStore *s, bool writable);
+
+/**
+ * @brief read the stats file fname and its journals into memory
+ *
+ * Like SS_open(s, false) for any stats file, e.g. the ones of other users.
+ * Headerless stats dumps are converted in memory.
+ */
+void SS_read(StatsStore *s, const char *fname);
+
+/**
+ * @brief compute the cells the lesson t changes and sync them to the journal
+ *
+ * The stats are not changed yet, SS_apply_lesson does that. A crash in
+ * between is recovered by the replay of the record.
+ *
+ * @param tick tick of the recent counts
+ */
+void SS_log_lesson(StatsStore *s, const Text *t, uint32_t tick);
+
+/**
+ * @brief apply the lesson logged last to the stats
+ *
+ * Checkpoints in the background if the journal grew too large.
+ */
+void SS_apply_lesson(StatsStore *s);
+
+/** @brief SS_log_lesson, then SS_apply_lesson */
+void SS_record_lesson(StatsStore *s, const Text *t, uint32_t tick);
+
+/**
+ * @brief checkpoint the stats, drop the journals and unmap the file
+ */
+void SS_close(StatsStore *s);
+
+#endif // STORE_H
@@ -0,0 +1,119 @@
+#include "stream.h"
+
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "thread_util.h"
+
+#define STREAM_ARENA_SIZE (1ul << 20)
+
+static void *generate(void *arg) {
+  LineStream *s = arg;
+  // the sampled words live until the next resampling
+  Arena arena = arena_new(STREAM_ARENA_SIZE);
+  WordListView view = {0};
+
+  pthread_mutex_lock(&s->lock);
+  while (!s->stop) {
+    if (s->stale) {
+      s->stale = false;
+      pthread_mutex_unlock(&s->lock);
+      arena_reset(&arena);
+      pthread_mutex_lock(&s->stats_lock);
+      view = s->sample(s->ctx, &s->rng, &arena);
+      pthread_mutex_unlock(&s->stats_lock);
+      pthread_mutex_lock(&s->lock);
+      // lines nobody saw yet follow the new stats too
+      s->n = s->n_shown;
+      continue;
+    }
+    if (s->n == STREAM_AHEAD) {
+      pthread_cond_wait(&s->changed, &s->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&s->lock);
+    StreamLine line;
+    for (int i = 0; i < STREAM_LINE_WORDS; ++i) {
+      line.words[i] = (int)WLV_id(&view, rng_below(&s->rng, view.nwords));
+    }
+    pthread_mutex_lock(&s->lock);
+    s->lines[(s->first + s->n) % STREAM_AHEAD] = line;
+    ++s->n;
+    pthread_cond_broadcast(&s->changed);
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  arena_free(&arena);
+  return NULL;
+}
+
+void ST_start(LineStream *s, StreamSampler sample, void *ctx, uint64_t seed) {
+  *s = (LineStream){
+      .sample = sample,
+      .ctx = ctx,
+      .rng = rng_seed(seed),
+      .stale = true,
+  };
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->changed, NULL);
+  pthread_mutex_init(&s->stats_lock, NULL);
+
+  const int err = start_worker(&s->generator, &generate, s);
+  if (err != 0) {
+    fprintf(stderr, "Error starting word generator: %s\nExiting...\n",
+            strerror(err));
+    exit(EXIT_FAILURE);
+  }
+}
+
+void ST_stop(LineStream *s) {
+  pthread_mutex_lock(&s->lock);
+  s->stop = true;
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+  pthread_join(s->generator, NULL);
+
+  pthread_mutex_destroy(&s->stats_lock);
+  pthread_cond_destroy(&s->changed);
+  pthread_mutex_destroy(&s->lock);
+}
+
+StreamLine ST_next(LineStream *s) {
+  pthread_mutex_lock(&s->lock);
+  while (s->n == 0) {
+    pthread_cond_wait(&s->changed, &s->lock);
+  }
+  const StreamLine line = s->lines[s->first];
+  s->first = (s->first + 1) % STREAM_AHEAD;
+  --s->n;
+  if (s->n_shown > 0) {
+    --s->n_shown;
+  }
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+  return line;
+}
+
+int ST_peek(LineStream *s, StreamLine *lines, int max) {
+  pthread_mutex_lock(&s->lock);
+  const int n = s->n < max ? s->n : max;
+  for (int i = 0; i < n; ++i) {
+    lines[i] = s->lines[(s->first + i) % STREAM_AHEAD];
+  }
+  if (n > s->n_shown) {
+    s->n_shown = n;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return n;
+}
+
+void ST_lock_stats(LineStream *s) { pthread_mutex_lock(&s->stats_lock); }
+
+void ST_unlock_stats(LineStream *s) {
+  pthread_mutex_unlock(&s->stats_lock);
+  pthread_mutex_lock(&s->lock);
+  s->stale = true;
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+}
@@ -0,0 +1,83 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "arena.h"
+#include "pthread.h"
+#include "sampler.h"
+#include "stdbool.h"
+#include "wordlist.h"
+
+// words of a line in endless mode
+#define STREAM_LINE_WORDS 10
+// lines sampled ahead of the ones being typed
+#define STREAM_AHEAD 8
+
+typedef struct {
+  int words[STREAM_LINE_WORDS];
+} StreamLine;
+
+/**
+ * @brief sample the words lines are drawn from, weighted by the stats
+ *
+ * Runs on the generator thread with the stats locked. The view may be
+ * allocated from arena, it is reset before the next call.
+ */
+typedef WordListView (*StreamSampler)(void *ctx, Rng *rng, Arena *arena);
+
+/**
+ * Endless supply of lines to type.
+ *
+ * A generator thread keeps STREAM_AHEAD lines queued, so the next line is
+ * ready as soon as the current one is typed. It samples them like lessons,
+ * again whenever new stats were recorded, and then replaces the queued lines
+ * that were not shown yet. The stats lock keeps it from reading the stats
+ * while they are written.
+ */
+typedef struct {
+  StreamSampler sample;
+  void *ctx;
+  Rng rng; //< only used by the generator
+
+  StreamLine lines[STREAM_AHEAD];
+  int first;  //< index of the next line in lines
+  int n;       //< lines queued
+  int n_shown; //< queued lines that ST_peek returned, they are kept
+  bool stale;  //< the stats changed since the words were sampled
+  bool stop;
+
+  pthread_mutex_t lock; //< guards the queue and the flags
+  pthread_cond_t changed;
+  pthread_mutex_t stats_lock;
+  pthread_t generator;
+} LineStream;
+
+/**
+ * @brief start generating lines from the words sample returns
+ *
+ * @param seed seed of the generator's Rng
+ */
+void ST_start(LineStream *s, StreamSampler sample, void *ctx, uint64_t seed);
+
+/** @brief stop the generator thread and free the stream */
+void ST_stop(LineStream *s);
+
+/** @brief take the next line, waiting only if the generator fell behind */
+StreamLine ST_next(LineStream *s);
+
+/**
+ * @brief copy up to max of the queued lines to show them, without taking
+ *        them
+ *
+ * The lines copied are no longer replaced when the stats change.
+ *
+ * @return number of lines copied
+ */
+int ST_peek(LineStream *s, StreamLine *lines, int max);
+
+/** @brief lock the stats before writing them */
+void ST_lock_stats(LineStream *s);
+
+/** @brief unlock the stats, the following lines are sampled from them */
+void ST_unlock_stats(LineStream *s);
+
+#endif // STREAM_H
@@ -0,0 +1,130 @@
+/**
+ * Kills a process between writing a lesson ahead to the journal and
+ * applying it to the mapped stats file, then checks that opening the store
+ * again recovers exactly the stats of all lessons.
+ */
+#include "keys.h"
+#include "signal.h"
+#include "stats.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "store.h"
+#include "string.h"
+#include "sys/wait.h"
+#include "unistd.h"
+
+#define MAX_CHARS 512
+
+typedef struct {
+  char chars[MAX_CHARS];
+  char typedchars[MAX_CHARS];
+  double time_to_type[MAX_CHARS];
+  bool errors[MAX_CHARS];
+} Lesson;
+
+static Lesson lessons[2];
+static ConfMatrix ref_confusions;
+static MonoGramDataSummary ref_mds;
+
+// random keys, every tenth one mistyped
+static Text make_lesson(Lesson *l, int n_chars) {
+  int n_errors = 0;
+  for (int i = 0; i < n_chars; ++i) {
+    l->chars[i] = keys[rand() % N_CHARS];
+    l->typedchars[i] = rand() % 10 ? l->chars[i] : keys[rand() % N_CHARS];
+    l->errors[i] = l->typedchars[i] != l->chars[i];
+    n_errors += l->errors[i];
+    l->time_to_type[i] = 50.0 + rand() % 350;
+  }
+  return (Text){
+      .n_chars = n_chars,
+      .chars = l->chars,
+      .typedchars = l->typedchars,
+      .time_to_type = l->time_to_type,
+      .errors = l->errors,
+      .n_errors = n_errors,
+  };
+}
+
+static bool same_stats(const StatsStore *s, const BigramTable *ref_bt) {
+  if (memcmp(s->confusions, &ref_confusions, sizeof(ConfMatrix)) != 0 ||
+      memcmp(s->mds, &ref_mds, sizeof(MonoGramDataSummary)) != 0 ||
+      s->bt->n != ref_bt->n) {
+    return false;
+  }
+  for (uint32_t i = 0; i < ref_bt->cap; ++i) {
+    const BigramEntry *ref = &ref_bt->entries[i];
+    if (ref->key == 0) {
+      continue;
+    }
+    const BigramEntry *e = BT_find(s->bt, BE_first(ref), BE_second(ref));
+    if (e == NULL || e->n_occurrences != ref->n_occurrences ||
+        e->n_misses != ref->n_misses ||
+        memcmp(&e->latency, &ref->latency, sizeof(Dist)) != 0 ||
+        memcmp(&e->recent_occurrences, &ref->recent_occurrences,
+               sizeof(Ewma)) != 0 ||
+        memcmp(&e->recent_misses, &ref->recent_misses, sizeof(Ewma)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(void) {
+  char dir[] = "/tmp/typtr_store_crashXXXXXX";
+  if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+    perror("Error creating test directory");
+    return EXIT_FAILURE;
+  }
+  init_crc_table();
+  srand(1);
+
+  // the second lesson has enough bigrams to grow the table
+  const Text first = make_lesson(&lessons[0], 100);
+  const Text second = make_lesson(&lessons[1], MAX_CHARS);
+  BigramTable ref_bt = BT_new();
+  update_conf_matrix(&ref_confusions, &first, 1);
+  MDS_update(&ref_mds, &first, 1);
+  BT_update(&ref_bt, &first, 1);
+  update_conf_matrix(&ref_confusions, &second, 2);
+  MDS_update(&ref_mds, &second, 2);
+  BT_update(&ref_bt, &second, 2);
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    StatsStore s;
+    SS_open(&s, true);
+    SS_record_lesson(&s, &first, 1);
+    SS_log_lesson(&s, &second, 2);
+    raise(SIGKILL);
+    _exit(EXIT_SUCCESS);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFSIGNALED(status) ||
+      WTERMSIG(status) != SIGKILL) {
+    fprintf(stderr, "the writer was not killed between the two steps\n");
+    return EXIT_FAILURE;
+  }
+
+  int failed = 0;
+  StatsStore s;
+  SS_open(&s, true);
+  if (s.seq != 2 || !same_stats(&s, &ref_bt)) {
+    fprintf(stderr, "replaying the journal did not recover the lessons\n");
+    ++failed;
+  }
+  SS_close(&s);
+
+  SS_read(&s, STORAGE_NAME);
+  if (s.seq != 2 || !same_stats(&s, &ref_bt)) {
+    fprintf(stderr, "the checkpoint did not keep the lessons\n");
+    ++failed;
+  }
+  SS_close(&s);
+
+  BT_free(&ref_bt);
+  unlink(STORAGE_NAME);
+  rmdir(dir);
+  deinit_crc_table();
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
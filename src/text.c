@@ -1,19 +1,24 @@
 #include "text.h"
 
+#include "arena.h"
 #include "assert.h"
 #include "memory.h"
 #include "stdlib.h"
 #include "term_handler.h"
 
-#define VERT_BOUND_LINES 5
+// typed lines kept in view above the current one
+#define SCROLL_CONTEXT_LINES 1
+// keystrokes expected per char of the text, typos included, the log grows
+// beyond them
+#define EVENTS_PER_CHAR 4
 #define HORZ_BOUND_CHARS 10
 
 #define check_pos(wl, pos)                                                     \
   assert(pos.word < wl.nwords && pos.word >= 0);                               \
   assert(pos.chr_idx < wl.words[pos.word].len && pos.chr_idx >= 0)
 
-Text T_create(WordList *w_list, int term_rows, int term_cols, int *indices,
-              int n_words) {
+Text T_create(Arena *arena, WordList *w_list, int term_rows, int term_cols,
+              int header_rows, int *indices, int n_words) {
   assert(n_words > 0);
 
   // determine number of chars
@@ -25,63 +30,42 @@ Text T_create(WordList *w_list, int term_rows, int term_cols, int *indices,
   n_chars += n_words - 1;
 
   assert(n_chars > 0);
-  char *allchars = calloc((unsigned long)n_chars, sizeof(char));
-
-  // initialise these two as oversize and then realloc
-  int *line_sizes = calloc((unsigned long)n_words, sizeof(int));
-  int *line_sizes_chars = calloc((unsigned long)n_words, sizeof(int));
-
+  // everything touched on each keystroke is allocated back to back
+  double *time_to_type =
+      arena_zalloc(arena, (unsigned long)n_chars * sizeof(double));
+  char *allchars = arena_zalloc(arena, (unsigned long)n_chars * sizeof(char));
+  char *typedchars =
+      arena_zalloc(arena, (unsigned long)n_chars * sizeof(char));
+  bool *errors = arena_zalloc(arena, (unsigned long)n_chars * sizeof(bool));
+  const int max_events = EVENTS_PER_CHAR * n_chars;
+  TextEvent *events =
+      arena_alloc(arena, (unsigned long)max_events * sizeof(TextEvent));
+
+  // oversize, there are at most as many lines as words
+  int *line_sizes = arena_alloc(arena, (unsigned long)n_words * sizeof(int));
+  int *line_sizes_chars =
+      arena_alloc(arena, (unsigned long)n_words * sizeof(int));
+  int *line_starts = arena_alloc(arena, (unsigned long)n_words * sizeof(int));
+  int *line_char_starts =
+      arena_alloc(arena, (unsigned long)n_words * sizeof(int));
+  TermPos *t_line_starts =
+      arena_alloc(arena, (unsigned long)n_words * sizeof(TermPos));
+
+  // words are separated by a single space, wherever the lines break
   int cur_char_idx = 0;
-  int cur_line = 0;
-
   for (int i = 0; i < n_words; ++i) {
     const SL *cur_word = &w_list->words[indices[i]];
     assert(cur_word->len > 0);
 
-    if (line_sizes_chars[cur_line] + cur_word->len + 1 >=
-        term_cols - 2 * HORZ_BOUND_CHARS) {
-      // add last space in line
-      allchars[cur_char_idx] = ' ';
-      ++cur_char_idx;
-      ++line_sizes_chars[cur_line];
-
-      ++cur_line;
+    if (i > 0) {
+      allchars[cur_char_idx++] = ' ';
     }
-
-    if (line_sizes_chars[cur_line] != 0) {
-      // spaces
-      allchars[cur_char_idx] = ' ';
-      ++cur_char_idx;
-      ++line_sizes_chars[cur_line];
-    }
-
     memcpy(&allchars[cur_char_idx], cur_word->start,
            (unsigned long)cur_word->len);
-
-    ++line_sizes[cur_line];
     cur_char_idx += cur_word->len;
-    line_sizes_chars[cur_line] += cur_word->len;
   }
 
-  const int n_lines = cur_line + 1;
-  assert(n_lines > 0);
-  int *line_starts = calloc((unsigned long)n_lines, sizeof(int));
-  line_sizes = realloc(line_sizes, (unsigned long)n_lines * sizeof(int));
-
-  for (int line = 1; line < n_lines; ++line) {
-    line_starts[line] = line_starts[line - 1] + line_sizes[line - 1];
-  }
-
-  TermPos *t_line_starts = malloc((unsigned long)n_lines * sizeof(TermPos));
-  for (int line = 0; line < n_lines; ++line) {
-    t_line_starts[line] =
-        (TermPos){.col = (term_cols - line_sizes_chars[line]) / 2,
-                  .row = line + (term_rows - n_lines) / 2};
-  }
-
-  printf("\n");
-
-  int *word_idcs = malloc((unsigned long)n_words * sizeof(int));
+  int *word_idcs = arena_alloc(arena, (unsigned long)n_words * sizeof(int));
   memcpy(word_idcs, indices, (unsigned long)n_words * sizeof(int));
 
   Text ret = {
@@ -90,31 +74,131 @@ Text T_create(WordList *w_list, int term_rows, int term_cols, int *indices,
       .line_sizes = line_sizes,
       .line_sizes_chars = line_sizes_chars,
       .line_starts = line_starts,
+      .line_char_starts = line_char_starts,
 
       .chars = allchars,
       .n_chars = n_chars,
       .n_words = n_words,
-      .n_lines = n_lines,
       .word_idcs = word_idcs,
       .w_list = w_list,
 
       .cur_char = 0,
       .cur_line_char = 0,
-      .time_to_type = malloc((unsigned long)n_chars * sizeof(double)),
-      .typedchars = malloc((unsigned long)n_chars * sizeof(char)),
-      .errors = malloc((unsigned long)n_chars * sizeof(bool)),
+      .time_to_type = time_to_type,
+      .typedchars = typedchars,
+      .errors = errors,
+      .events = events,
+      .max_events = max_events,
+      .arena = arena,
   };
+  T_layout(&ret, term_rows, term_cols, header_rows);
 
   return ret;
 }
 
-void T_draw_all(Text t) {
-  for (int line = 0; line < t.n_lines; ++line) {
-    goto_term_pos(t.t_line_starts[line]);
+// keep the current line in view, true if the view moved
+static bool scroll(Text *t) {
+  int top = t->pos.line - SCROLL_CONTEXT_LINES;
+  if (top > t->n_lines - t->view_lines) {
+    top = t->n_lines - t->view_lines;
+  }
+  if (top < 0) {
+    top = 0;
+  }
+  const bool moved = top != t->top_line;
+  t->top_line = top;
+  return moved;
+}
+
+void T_layout(Text *t, int term_rows, int term_cols, int header_rows) {
+  int cur_line = 0;
+  t->line_sizes[0] = 0;
+  t->line_sizes_chars[0] = 0;
+
+  for (int i = 0; i < t->n_words; ++i) {
+    const int len = t->w_list->words[t->word_idcs[i]].len;
+
+    if (t->line_sizes[cur_line] != 0 &&
+        t->line_sizes_chars[cur_line] + len + 1 >=
+            term_cols - 2 * HORZ_BOUND_CHARS) {
+      // the space after the last word ends the line
+      ++t->line_sizes_chars[cur_line];
 
-    for (int l_word_idx = 0; l_word_idx < t.line_sizes[line]; ++l_word_idx) {
-      const int word_idx = t.word_idcs[l_word_idx + t.line_starts[line]];
-      printf(SL_FMT " ", SL_FP(t.w_list->words[word_idx]));
+      ++cur_line;
+      t->line_sizes[cur_line] = 0;
+      t->line_sizes_chars[cur_line] = 0;
+    }
+
+    if (t->line_sizes_chars[cur_line] != 0) {
+      // spaces
+      ++t->line_sizes_chars[cur_line];
+    }
+
+    ++t->line_sizes[cur_line];
+    t->line_sizes_chars[cur_line] += len;
+  }
+
+  t->n_lines = cur_line + 1;
+  t->line_starts[0] = 0;
+  t->line_char_starts[0] = 0;
+  for (int line = 1; line < t->n_lines; ++line) {
+    t->line_starts[line] = t->line_starts[line - 1] + t->line_sizes[line - 1];
+    t->line_char_starts[line] =
+        t->line_char_starts[line - 1] + t->line_sizes_chars[line - 1];
+  }
+
+  // the view is centered a blank row below the header, longer texts scroll
+  // through it
+  t->view_lines = term_rows - header_rows - 1;
+  if (t->view_lines < 1) {
+    t->view_lines = 1;
+  }
+  const int shown = t->n_lines < t->view_lines ? t->n_lines : t->view_lines;
+  const int first_row = header_rows + 2 + (t->view_lines - shown) / 2;
+  for (int line = 0; line < t->n_lines; ++line) {
+    t->t_line_starts[line] =
+        (TermPos){.col = (term_cols - t->line_sizes_chars[line]) / 2,
+                  .row = first_row + line};
+  }
+
+  // find the current char again
+  int line = 0;
+  while (line < t->n_lines - 1 &&
+         t->cur_char >= t->line_char_starts[line + 1]) {
+    ++line;
+  }
+  t->pos.line = line;
+  t->cur_line_char = t->cur_char - t->line_char_starts[line];
+  scroll(t);
+}
+
+// where line starts on the terminal in the current view
+static TermPos line_start(const Text *t, int line) {
+  const TermPos start = t->t_line_starts[line];
+  return (TermPos){.row = start.row - t->top_line, .col = start.col};
+}
+
+TermPos T_cursor(const Text *t) {
+  const TermPos start = line_start(t, t->pos.line);
+  return (TermPos){.row = start.row, .col = start.col + t->cur_line_char};
+}
+
+void T_draw_all(Text t, Screen *scr) {
+  int end_line = t.top_line + t.view_lines;
+  if (end_line > t.n_lines) {
+    end_line = t.n_lines;
+  }
+  for (int line = t.top_line; line < end_line; ++line) {
+    SCR_goto(scr, line_start(&t, line));
+
+    int i = t.line_char_starts[line];
+    const int line_end = i + t.line_sizes_chars[line];
+    for (; i < line_end && i < t.cur_char; ++i) {
+      const char c = t.chars[i] == ' ' ? '_' : t.chars[i];
+      SCR_printf(scr, "%s%c" RST, t.errors[i] ? RED : GRN, c);
+    }
+    for (; i < line_end; ++i) {
+      SCR_printf(scr, "%c", t.chars[i]);
     }
   }
 }
@@ -131,12 +215,25 @@ bool T_advance_char(Text *t, TermPos *term_pos) {
 
     ++t->pos.line;
     t->cur_line_char = 0;
-    const TermPos next_line_start = t->t_line_starts[line + 1];
-    term_pos->row = next_line_start.row;
-    term_pos->col = next_line_start.col;
+    scroll(t);
+    *term_pos = line_start(t, line + 1);
   } else {
     ++term_pos->col;
   }
 
   return true;
 }
+
+void T_record_event(Text *t, char c, uint64_t time_ns) {
+  if (t->n_events == t->max_events) {
+    // the old log stays in the arena until the lesson ends
+    const int max_events = 2 * t->max_events;
+    TextEvent *events =
+        arena_alloc(t->arena, (unsigned long)max_events * sizeof(TextEvent));
+    memcpy(events, t->events, (unsigned long)t->n_events * sizeof(TextEvent));
+    t->events = events;
+    t->max_events = max_events;
+  }
+  t->events[t->n_events++] =
+      (TextEvent){.time_ns = time_ns, .pos = t->cur_char, .c = c};
+}
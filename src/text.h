@@ -1,6 +1,9 @@
 #ifndef TEXT_H
 #define TEXT_H
 
+#include "arena.h"
+#include "stdint.h"
+#include "screen.h"
 #include "term_handler.h"
 #include "wordlist.h"
 
@@ -10,6 +13,13 @@ typedef struct {
   int chr_idx;
 } TextPos;
 
+/** a key pressed while typing the text, right or wrong */
+typedef struct {
+  uint64_t time_ns; //< CLOCK_MONOTONIC when it was read
+  int pos;          //< index of the char it was typed for
+  char c;
+} TextEvent;
+
 typedef struct {
   TextPos pos;
 
@@ -19,29 +29,80 @@ typedef struct {
   const int n_chars;
   const char* chars;
 
-  const int n_lines;
-  const int* line_sizes_chars;
+  // layout for the terminal size, T_layout redoes it in place. The arrays
+  // hold n_words entries, the most lines there can be.
+  int n_lines;
+  int *line_sizes_chars;
   const int* nwords_l;
 
-  const TermPos* t_line_starts;
+  TermPos *t_line_starts;
 
   const WordList *w_list;
   const int *word_idcs;
   const int n_words;
 
-  const int *line_starts;
-  const int *line_sizes;
+  int *line_starts;
+  int *line_sizes;
+  int *line_char_starts;
+
+  // lines of the text on the terminal, scrolled to keep the current one in
+  // view. t_line_starts are positions before scrolling.
+  int view_lines;
+  int top_line;
 
   bool *errors;
   int n_errors;
   char *typedchars;
   double *time_to_type;
+
+  // every keystroke, the log grows in arena when it is full
+  TextEvent *events;
+  int n_events;
+  int max_events;
+
+  Arena *arena;
 } Text;
 
-Text T_create(WordList *w_list, int term_rows, int term_cols, int *indices,
-              int n_words);
+/**
+ * @brief lay out the words at indices in w_list for the terminal
+ *
+ * header_rows are the rows at the top taken by other output, as for
+ * T_layout. All arrays of the Text are allocated from arena and live until
+ * it is reset.
+ */
+Text T_create(Arena *arena, WordList *w_list, int term_rows, int term_cols,
+              int header_rows, int *indices, int n_words);
+
+/**
+ * @brief break the lines and center them for a terminal of the given size
+ *
+ * The text goes below the first header_rows rows of the terminal. The
+ * position in the text is kept. Linear in the number of words and without
+ * allocations, so it can run in the middle of a timed lesson.
+ */
+void T_layout(Text *t, int term_rows, int term_cols, int header_rows);
 
-void T_draw_all(Text t);
+/** @brief where the current char is on the terminal */
+TermPos T_cursor(const Text *t);
 
+/**
+ * @brief draw the lines in view into the next frame of scr, the typed chars
+ *        colored like while typing
+ *
+ * Only the view is drawn, so the cost does not grow with the text.
+ */
+void T_draw_all(Text t, Screen *scr);
+
+/**
+ * @brief move to the next char and set term_pos to it
+ *
+ * The view scrolls when the next line starts, then top_line changes and the
+ * text has to be drawn again.
+ *
+ * @return false after the last char
+ */
 bool T_advance_char(Text *t, TermPos* term_pos);
+
+/** @brief log key c typed at time_ns for the current char */
+void T_record_event(Text *t, char c, uint64_t time_ns);
 #endif // TEXT_H
@@ -0,0 +1,14 @@
+#ifndef THREAD_UTIL_H
+#define THREAD_UTIL_H
+#include "pthread.h"
+
+/**
+ * @brief pthread_create for a worker that never handles signals
+ *
+ * The thread starts with all signals blocked, so SIGINT and SIGWINCH reach
+ * the UI thread, where they interrupt the wait for the next key.
+ *
+ * @return 0 or the error of pthread_create
+ */
+int start_worker(pthread_t *thread, void *(*fn)(void *), void *arg);
+#endif
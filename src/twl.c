@@ -0,0 +1,278 @@
+#include "twl.h"
+
+#include "assert.h"
+#include "errno.h"
+#include "fcntl.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+static uint64_t align_up(uint64_t off) {
+  return (off + TWL_ALIGN - 1) & ~(uint64_t)(TWL_ALIGN - 1);
+}
+
+static bool write_section(FILE *f, uint64_t off, const void *data,
+                          uint64_t size) {
+  static const char zeros[TWL_ALIGN] = {0};
+  const long pos = ftell(f);
+  assert(pos >= 0 && (uint64_t)pos <= off);
+  if (fwrite(zeros, 1, off - (uint64_t)pos, f) != off - (uint64_t)pos) {
+    return false;
+  }
+  return fwrite(data, 1, size, f) == size;
+}
+
+bool TWL_write(FILE *f, const WordList *wl) {
+  const unsigned long n_words = (unsigned long)wl->nwords;
+
+  uint32_t *word_starts = malloc(n_words * sizeof(uint32_t));
+  uint32_t *word_lens = malloc(n_words * sizeof(uint32_t));
+  CharMask *masks = malloc(n_words * sizeof(CharMask));
+  uint32_t *bigram_starts = malloc((n_words + 1) * sizeof(uint32_t));
+
+  // words are stored packed, each followed by a newline so the chars section
+  // is still a readable word list
+  uint64_t n_chars = 0;
+  uint64_t max_bigrams = 0;
+  for (unsigned long i = 0; i < n_words; ++i) {
+    n_chars += (uint64_t)wl->words[i].len + 1;
+    max_bigrams += (uint64_t)wl->words[i].len;
+  }
+  char *chars = malloc(n_chars);
+  BigramId *bigrams = malloc(max_bigrams * sizeof(BigramId));
+
+  // last word that contained a bigram, for deduplication within a word
+  long *seen = malloc(N_CHARS * N_CHARS * sizeof(long));
+  for (long i = 0; i < N_CHARS * N_CHARS; ++i) {
+    seen[i] = -1;
+  }
+
+  uint64_t cur_char = 0;
+  uint64_t n_bigrams = 0;
+  for (unsigned long i = 0; i < n_words; ++i) {
+    const SL word = wl->words[i];
+    word_starts[i] = (uint32_t)cur_char;
+    word_lens[i] = (uint32_t)word.len;
+    memcpy(&chars[cur_char], word.start, (unsigned long)word.len);
+    cur_char += (uint64_t)word.len;
+    chars[cur_char++] = '\n';
+
+    masks[i] = CM_of_chars(word.start, word.len);
+
+    bigram_starts[i] = (uint32_t)n_bigrams;
+    for (int c = 0; c < word.len - 1; ++c) {
+      if (!is_key(word.start[c]) || !is_key(word.start[c + 1])) {
+        continue;
+      }
+      const int id =
+          char_idx(word.start[c]) * N_CHARS + char_idx(word.start[c + 1]);
+      if (seen[id] != (long)i) {
+        seen[id] = (long)i;
+        bigrams[n_bigrams++] = (BigramId)id;
+      }
+    }
+  }
+  bigram_starts[n_words] = (uint32_t)n_bigrams;
+
+  TwlHeader header = {
+      .magic = TWL_MAGIC,
+      .version = TWL_VERSION,
+      .byte_order = TWL_BYTE_ORDER,
+      .alphabet_size = N_CHARS,
+      .n_words = n_words,
+      .n_chars = n_chars,
+      .n_bigrams = n_bigrams,
+  };
+  header.chars_off = align_up(sizeof(TwlHeader));
+  header.word_starts_off = align_up(header.chars_off + n_chars);
+  header.word_lens_off =
+      align_up(header.word_starts_off + n_words * sizeof(uint32_t));
+  header.masks_off =
+      align_up(header.word_lens_off + n_words * sizeof(uint32_t));
+  header.bigram_starts_off =
+      align_up(header.masks_off + n_words * sizeof(CharMask));
+  header.bigrams_off = align_up(header.bigram_starts_off +
+                                (n_words + 1) * sizeof(uint32_t));
+  header.postings_starts_off =
+      align_up(header.bigrams_off + n_bigrams * sizeof(BigramId));
+  header.postings_off = align_up(header.postings_starts_off +
+                                 (N_CHARS * N_CHARS + 1) * sizeof(uint32_t));
+  if (wl->freqs) {
+    header.freqs_off =
+        align_up(header.postings_off + n_bigrams * sizeof(uint32_t));
+  }
+
+  const BigramPostings postings = BP_build(wl);
+  assert(postings.starts[N_CHARS * N_CHARS] == n_bigrams);
+
+  const bool ok =
+      write_section(f, 0, &header, sizeof(TwlHeader)) &&
+      write_section(f, header.chars_off, chars, n_chars) &&
+      write_section(f, header.word_starts_off, word_starts,
+                    n_words * sizeof(uint32_t)) &&
+      write_section(f, header.word_lens_off, word_lens,
+                    n_words * sizeof(uint32_t)) &&
+      write_section(f, header.masks_off, masks, n_words * sizeof(CharMask)) &&
+      write_section(f, header.bigram_starts_off, bigram_starts,
+                    (n_words + 1) * sizeof(uint32_t)) &&
+      write_section(f, header.bigrams_off, bigrams,
+                    n_bigrams * sizeof(BigramId)) &&
+      write_section(f, header.postings_starts_off, postings.starts,
+                    (N_CHARS * N_CHARS + 1) * sizeof(uint32_t)) &&
+      write_section(f, header.postings_off, postings.word_ids,
+                    n_bigrams * sizeof(uint32_t)) &&
+      (!wl->freqs || write_section(f, header.freqs_off, wl->freqs,
+                                   n_words * sizeof(float)));
+
+  BP_free(postings);
+  free(seen);
+  free(bigrams);
+  free(chars);
+  free(bigram_starts);
+  free(masks);
+  free(word_lens);
+  free(word_starts);
+  return ok;
+}
+
+static bool section_fits(uint64_t off, uint64_t size, uint64_t fsize) {
+  return off % TWL_ALIGN == 0 && off <= fsize && size <= fsize - off;
+}
+
+static bool header_valid(const TwlHeader *h, uint64_t fsize) {
+  if (memcmp(h->magic, TWL_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != TWL_VERSION || h->byte_order != TWL_BYTE_ORDER ||
+      h->alphabet_size != N_CHARS || h->n_words > UINT32_MAX) {
+    return false;
+  }
+  return section_fits(h->chars_off, h->n_chars, fsize) &&
+         section_fits(h->word_starts_off, h->n_words * sizeof(uint32_t),
+                      fsize) &&
+         section_fits(h->word_lens_off, h->n_words * sizeof(uint32_t),
+                      fsize) &&
+         section_fits(h->masks_off, h->n_words * sizeof(CharMask), fsize) &&
+         section_fits(h->bigram_starts_off,
+                      (h->n_words + 1) * sizeof(uint32_t), fsize) &&
+         section_fits(h->bigrams_off, h->n_bigrams * sizeof(BigramId),
+                      fsize) &&
+         section_fits(h->postings_starts_off,
+                      (N_CHARS * N_CHARS + 1) * sizeof(uint32_t), fsize) &&
+         section_fits(h->postings_off, h->n_bigrams * sizeof(uint32_t),
+                      fsize) &&
+         (h->freqs_off == 0 ||
+          section_fits(h->freqs_off, h->n_words * sizeof(float), fsize));
+}
+
+static bool postings_valid(const TwlIndex *index) {
+  const TwlHeader *h = index->header;
+  for (long i = 0; i < N_CHARS * N_CHARS; ++i) {
+    if (index->postings_starts[i] > index->postings_starts[i + 1]) {
+      return false;
+    }
+  }
+  if (index->postings_starts[0] != 0 ||
+      index->postings_starts[N_CHARS * N_CHARS] != h->n_bigrams) {
+    return false;
+  }
+  for (uint64_t i = 0; i < h->n_bigrams; ++i) {
+    if (index->postings[i] >= h->n_words) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TWL_load(const char *fname, WordList *wl, TwlIndex *index) {
+  errno = 0;
+  const int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      fprintf(stderr, "Error opening compiled word list '%s': %s\n", fname,
+              strerror(errno));
+    }
+    errno = 0;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(TwlHeader)) {
+    fprintf(stderr, "Invalid compiled word list '%s'\n", fname);
+    close(fd);
+    errno = 0;
+    return false;
+  }
+  const uint64_t fsize = (uint64_t)st.st_size;
+
+  const char *map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "Error mapping compiled word list '%s': %s\n", fname,
+            strerror(errno));
+    errno = 0;
+    return false;
+  }
+
+  const TwlHeader *h = (const TwlHeader *)map;
+  if (!header_valid(h, fsize)) {
+    fprintf(stderr, "Invalid compiled word list '%s'\n", fname);
+    munmap((void *)map, fsize);
+    return false;
+  }
+
+  *index = (TwlIndex){
+      .header = h,
+      .word_starts = (const uint32_t *)&map[h->word_starts_off],
+      .word_lens = (const uint32_t *)&map[h->word_lens_off],
+      .masks = (const CharMask *)&map[h->masks_off],
+      .bigram_starts = (const uint32_t *)&map[h->bigram_starts_off],
+      .bigrams = (const BigramId *)&map[h->bigrams_off],
+      .freqs = h->freqs_off ? (const float *)&map[h->freqs_off] : NULL,
+      .postings_starts = (const uint32_t *)&map[h->postings_starts_off],
+      .postings = (const uint32_t *)&map[h->postings_off],
+  };
+
+  if (!postings_valid(index)) {
+    fprintf(stderr, "Invalid compiled word list '%s'\n", fname);
+    munmap((void *)map, fsize);
+    return false;
+  }
+
+  // no tokenizing, the SL views are only a pointer fixup per word
+  const char *chars = &map[h->chars_off];
+  SL *words = malloc(h->n_words * sizeof(SL));
+  for (uint64_t i = 0; i < h->n_words; ++i) {
+    const uint64_t start = index->word_starts[i];
+    const uint64_t len = index->word_lens[i];
+    if (len > INT32_MAX || start + len > h->n_chars ||
+        index->bigram_starts[i] > index->bigram_starts[i + 1] ||
+        index->bigram_starts[i + 1] > h->n_bigrams) {
+      fprintf(stderr, "Invalid compiled word list '%s'\n", fname);
+      free(words);
+      munmap((void *)map, fsize);
+      return false;
+    }
+    words[i] = (SL){.start = &chars[start], .len = (int)len};
+  }
+
+  *wl = (WordList){
+      .chars = chars,
+      .words = words,
+      .masks = index->masks,
+      .freqs = index->freqs,
+      .nwords = (long)h->n_words,
+      .nchars = (long)h->n_chars,
+      .map = map,
+      .map_size = (long)fsize,
+  };
+  return true;
+}
+
+BigramPostings TWL_postings(const TwlIndex *index) {
+  return (BigramPostings){
+      .starts = index->postings_starts,
+      .word_ids = index->postings,
+      .mapped = true,
+  };
+}
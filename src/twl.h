@@ -0,0 +1,86 @@
+#ifndef TWL_H
+#define TWL_H
+
+#include "keys.h"
+#include "stdint.h"
+#include "stdio.h"
+#include "wordlist.h"
+
+#define TWL_MAGIC "TWL"
+#define TWL_VERSION 3
+#define TWL_BYTE_ORDER 0x01020304u
+#define TWL_ALIGN 16
+
+/** bigram id, first * N_CHARS + second */
+typedef uint16_t BigramId;
+
+/**
+ * On-disk header of a compiled word list.
+ *
+ * All section offsets are in bytes from the start of the file and aligned to
+ * TWL_ALIGN. All integers are stored in host byte order, byte_order is used to
+ * detect files from machines with a different one.
+ */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t alphabet_size; //< N_CHARS at compile time
+  uint64_t n_words;
+  uint64_t n_chars;   //< size of chars section
+  uint64_t n_bigrams; //< total number of entries in bigrams section
+
+  uint64_t chars_off;         //< char[n_chars]
+  uint64_t word_starts_off;   //< uint32_t[n_words], offsets into chars
+  uint64_t word_lens_off;     //< uint32_t[n_words]
+  uint64_t masks_off;         //< CharMask[n_words]
+  uint64_t bigram_starts_off; //< uint32_t[n_words + 1], offsets into bigrams
+  uint64_t bigrams_off;       //< BigramId[n_bigrams], unique per word
+  uint64_t freqs_off;         //< float[n_words], 0 if there are no frequencies
+  uint64_t postings_starts_off; //< uint32_t[N_CHARS * N_CHARS + 1]
+  uint64_t postings_off;        //< uint32_t[n_bigrams], word ids per bigram
+} TwlHeader;
+
+/**
+ * Views into a mapped compiled word list. Does not own any memory, the
+ * mapping is owned by the WordList that was loaded alongside it.
+ */
+typedef struct {
+  const TwlHeader *header;
+  const uint32_t *word_starts;
+  const uint32_t *word_lens;
+  const CharMask *masks;
+  const uint32_t *bigram_starts;
+  const BigramId *bigrams;
+  const float *freqs; //< NULL if there are no frequencies
+  const uint32_t *postings_starts;
+  const uint32_t *postings;
+} TwlIndex;
+
+/**
+ * @brief compile wl into the binary word list format and write it to f
+ *
+ * @return true on success
+ */
+bool TWL_write(FILE *f, const WordList *wl);
+
+/**
+ * @brief map a compiled word list
+ *
+ * @param fname compiled word list file
+ * @param wl WordList with views into the mapping, release with WL_free
+ * @param index section views into the mapping, valid as long as wl
+ *
+ * @return false if the file does not exist or is not a valid word list of
+ *         this version
+ */
+bool TWL_load(const char *fname, WordList *wl, TwlIndex *index);
+
+/**
+ * @brief bigram to word inverted index stored in the compiled word list
+ *
+ * Returns views into the mapping, BP_free is a no-op for them.
+ */
+BigramPostings TWL_postings(const TwlIndex *index);
+
+#endif // TWL_H
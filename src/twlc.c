@@ -0,0 +1,47 @@
+#include "corpus.h"
+#include "twl.h"
+#include "wordlist.h"
+
+#include "errno.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#define SL_IMPLEMENTATION
+#include "sl.h"
+
+int main(int argc, char **argv) {
+  const bool corpus = argc == 4 && strcmp(argv[1], "-c") == 0;
+  if (argc != 3 && !corpus) {
+    fprintf(stderr,
+            "Usage: %s [-c] <word list> <output.twl>\n"
+            "  -c  read arbitrary text and keep the %d most frequent words\n",
+            argv[0], CORPUS_DEFAULT_WORDS);
+    exit(EXIT_FAILURE);
+  }
+  const char *in_name = argv[argc - 2];
+  const char *out_name = argv[argc - 1];
+
+  WordList wl = corpus ? get_corpus_wordlist(in_name, CORPUS_DEFAULT_WORDS)
+                       : get_mmapped_wordlist(in_name);
+
+  errno = 0;
+  FILE *out = fopen(out_name, "w");
+  if (errno) {
+    fprintf(stderr, "Error opening output file '%s': %s\nExiting...\n",
+            out_name, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if (!TWL_write(out, &wl)) {
+    fprintf(stderr, "Error writing compiled word list '%s'\nExiting...\n",
+            out_name);
+    exit(EXIT_FAILURE);
+  }
+  fclose(out);
+
+  printf("Compiled %ld words from '%s' into '%s'\n", wl.nwords, in_name,
+         out_name);
+  WL_free(wl);
+  return EXIT_SUCCESS;
+}
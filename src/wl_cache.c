@@ -0,0 +1,122 @@
+#include "wl_cache.h"
+
+#include "errno.h"
+#include "fcntl.h"
+#include "limits.h"
+#include "stats.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
+
+static bool make_dir(const char *path) {
+  if (mkdir(path, 0755) == 0 || errno == EEXIST) {
+    errno = 0;
+    return true;
+  }
+  return false;
+}
+
+static bool cache_dir(char *buf, unsigned long size) {
+  char base[PATH_MAX];
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int len;
+  if (xdg && xdg[0] != '\0') {
+    len = snprintf(base, sizeof(base), "%s", xdg);
+  } else if (home && home[0] != '\0') {
+    len = snprintf(base, sizeof(base), "%s/.cache", home);
+  } else {
+    return false;
+  }
+  if (len < 0 || (unsigned long)len >= sizeof(base) || !make_dir(base)) {
+    return false;
+  }
+
+  len = snprintf(buf, size, "%s/" CACHE_DIR_NAME, base);
+  return len >= 0 && (unsigned long)len < size && make_dir(buf);
+}
+
+static bool file_key(const char *fname, uint32_t *crc, long *size) {
+  const int fd = open(fname, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+
+  const char *data =
+      mmap(NULL, (unsigned long)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  madvise((void *)data, (unsigned long)st.st_size, MADV_SEQUENTIAL);
+  *crc = crc32(data, st.st_size);
+  *size = st.st_size;
+  munmap((void *)data, (unsigned long)st.st_size);
+  return true;
+}
+
+static bool write_entry(const char *path, const WordList *wl) {
+  // write to a private file and rename, so readers never see partial entries
+  char tmp_path[PATH_MAX];
+  const int len =
+      snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, getpid());
+  if (len < 0 || (unsigned long)len >= sizeof(tmp_path)) {
+    return false;
+  }
+
+  FILE *f = fopen(tmp_path, "w");
+  if (f == NULL) {
+    return false;
+  }
+  const bool written = TWL_write(f, wl);
+  if (fclose(f) != 0 || !written || rename(tmp_path, path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+bool WL_load_cached(const char *fname, uint32_t variant, WordListLoader load,
+                    WordList *wl, TwlIndex *index) {
+  char dir[PATH_MAX];
+  char path[PATH_MAX];
+  uint32_t crc;
+  long size;
+
+  errno = 0;
+  if (!cache_dir(dir, sizeof(dir)) || !file_key(fname, &crc, &size)) {
+    errno = 0;
+    *wl = load(fname);
+    return false;
+  }
+
+  const int len = snprintf(path, sizeof(path), "%s/v%d-%08x-%lx-%x.twl", dir,
+                           TWL_VERSION, crc, size, variant);
+  if (len < 0 || (unsigned long)len >= sizeof(path)) {
+    *wl = load(fname);
+    return false;
+  }
+
+  if (TWL_load(path, wl, index)) {
+    return true;
+  }
+
+  WordList fresh = load(fname);
+  const bool written = write_entry(path, &fresh);
+  errno = 0;
+  if (written && TWL_load(path, wl, index)) {
+    WL_free(fresh);
+    return true;
+  }
+
+  *wl = fresh;
+  return false;
+}
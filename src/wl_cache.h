@@ -0,0 +1,34 @@
+#ifndef WL_CACHE_H
+#define WL_CACHE_H
+
+#include "stdint.h"
+#include "twl.h"
+#include "wordlist.h"
+
+#define CACHE_DIR_NAME "typtr"
+
+typedef WordList (*WordListLoader)(const char *fname);
+
+/**
+ * @brief load a WordList through the cache of compiled word lists
+ *
+ * The cache lives in $XDG_CACHE_HOME/typtr (or ~/.cache/typtr) and is keyed by
+ * the CRC32 and size of fname, the loader variant and TWL_VERSION, so changing
+ * the file or the format invalidates the entry without bookkeeping. On a miss,
+ * fname is loaded with load, compiled and written to the cache.
+ *
+ * Needs init_crc_table to have been called.
+ *
+ * @param fname source file of the word list
+ * @param variant distinguishes loaders / loader settings for the same file
+ * @param load loader for fname on a cache miss
+ * @param wl loaded WordList
+ * @param index compiled sections, only set if true is returned
+ *
+ * @return true if wl is backed by a cache entry, false if the cache could not
+ *         be used and wl was loaded with load directly
+ */
+bool WL_load_cached(const char *fname, uint32_t variant, WordListLoader load,
+                    WordList *wl, TwlIndex *index);
+
+#endif // WL_CACHE_H
@@ -5,107 +5,209 @@
 #include "sl.h"
 #include "stdio.h"
 #include "stdlib.h"
+#include "fcntl.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "unistd.h"
 #include <string.h>
 
+static bool WL_in_map(const WordList *wl, const void *p) {
+  const char *map = wl->map;
+  return map != NULL && (const char *)p >= map &&
+         (const char *)p < map + wl->map_size;
+}
+
 void WL_free(WordList wl) {
-  free((void *)wl.chars);
+  if (!WL_in_map(&wl, wl.masks)) {
+    free((void *)wl.masks);
+  }
+  if (!WL_in_map(&wl, wl.freqs)) {
+    free((void *)wl.freqs);
+  }
+  if (wl.map) {
+    munmap((void *)wl.map, (unsigned long)wl.map_size);
+  } else {
+    free((void *)wl.chars);
+  }
   free((void *)wl.words);
 }
 
-WordList get_malloced_wordlist(const char *fname) {
+WordList get_mmapped_wordlist(const char *fname) {
   errno = 0;
-  FILE *f = fopen(fname, "r");
+  const int fd = open(fname, O_RDONLY);
+  exit_err_file("Error opening wordlist file", fname);
 
-  if (errno) {
-    fprintf(stderr, "Error opening wordlist file '%s': %s\nExiting...\n", fname,
-            strerror(errno));
-    exit(EXIT_FAILURE);
-  }
-
-  const long fsize = get_fsize_or_panic(f, fname);
+  struct stat st;
+  fstat(fd, &st);
+  exit_err_file("Error getting word list file size", fname);
 
+  const long fsize = st.st_size;
   assert(fsize > 0);
-  char *chars = malloc((unsigned long)fsize * sizeof(char));
-  fread(chars, (unsigned long)fsize, 1, f);
-  exit_err_file("Error reading file", fname);
-
-  fclose(f);
-  exit_err_file("Error closing file", fname);
 
-  WordList ret = {
-      .nchars = fsize,
-      .chars = chars,
-  };
-
-  long word_count = 1;
-  for (long pos = 0; pos < ret.nchars; ++pos) {
-    if (ret.chars[pos] == '\n' || ret.chars[pos] == ' ') {
-      ++word_count;
-    }
+  const char *chars =
+      mmap(NULL, (unsigned long)fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (chars == MAP_FAILED) {
+    exit_err_file("Error mapping wordlist file", fname);
   }
+  // the mapping stays valid after the descriptor is gone
+  close(fd);
+  madvise((void *)chars, (unsigned long)fsize, MADV_SEQUENTIAL);
+
+  // single pass over the mapping, growing the SL array as we go
+  long cap = 1024;
+  long nwords = 0;
+  SL *words = malloc((unsigned long)cap * sizeof(SL));
+  CharMask *masks = malloc((unsigned long)cap * sizeof(CharMask));
+  float *freqs = calloc((unsigned long)cap, sizeof(float));
+  bool has_freqs = false;
+
+  long word_start = 0;
+  for (long pos = 0; pos <= fsize; ++pos) {
+    if (pos < fsize && chars[pos] != '\n' && chars[pos] != ' ' &&
+        chars[pos] != '\t') {
+      continue;
+    }
 
-  SL *words = malloc((unsigned long)word_count * sizeof(SL));
-
-  long cur_word_start = 0;
-  long invalid_words = 0;
-  for (long wi = 0; wi < word_count; ++wi) {
-    long word_length = 0;
-    while (!(ret.chars[cur_word_start + word_length] == '\n' ||
-             ret.chars[cur_word_start + word_length] == ' ')) {
-      ++word_length;
-      if (cur_word_start + word_length >= ret.nchars)
-        break;
+    if (pos > word_start) {
+      if (nwords == cap) {
+        cap *= 2;
+        words = realloc(words, (unsigned long)cap * sizeof(SL));
+        masks = realloc(masks, (unsigned long)cap * sizeof(CharMask));
+        freqs = realloc(freqs, (unsigned long)cap * sizeof(float));
+        memset(&freqs[nwords], 0x0,
+               (unsigned long)(cap - nwords) * sizeof(float));
+      }
+      words[nwords] = (SL){.start = &chars[word_start],
+                           .len = (int)(pos - word_start)};
+      masks[nwords] = CM_of_chars(words[nwords].start, words[nwords].len);
+      ++nwords;
     }
 
-    if (word_length > 0) {
-      words[wi - invalid_words] =
-          (SL){.start = &ret.chars[cur_word_start], .len = word_length};
-      cur_word_start += word_length + 1;
-    } else {
-      ++invalid_words;
+    // word<TAB>count, the count belongs to the word just before the tab
+    if (pos < fsize && chars[pos] == '\t' && pos > word_start) {
+      double count = 0.0;
+      while (pos + 1 < fsize && chars[pos + 1] >= '0' &&
+             chars[pos + 1] <= '9') {
+        ++pos;
+        count = count * 10.0 + (chars[pos] - '0');
+      }
+      freqs[nwords - 1] = (float)count;
+      has_freqs = true;
+      // skip anything else up to the end of the line
+      while (pos + 1 < fsize && chars[pos + 1] != '\n') {
+        ++pos;
+      }
     }
+    word_start = pos + 1;
   }
 
-  ret.words =
-      realloc(words, (unsigned long)(word_count - invalid_words) * sizeof(SL));
-  ret.nwords = word_count - invalid_words;
+  if (!has_freqs) {
+    free(freqs);
+    freqs = NULL;
+  }
 
-  return ret;
+  return (WordList){
+      .chars = chars,
+      .words = words,
+      .masks = masks,
+      .freqs = freqs,
+      .nwords = nwords,
+      .nchars = fsize,
+      .map = chars,
+      .map_size = fsize,
+  };
 }
 
-void WL_deepcopy(const WordList* src, WordList* dst) {
-  dst->nchars = src->nchars;
-  dst->nwords = src->nwords;
-  SL* words = malloc((unsigned long)src->nwords * sizeof(SL));
-  char* chars = malloc((unsigned long)src->nchars * sizeof(char));
+WordListView WLV_all(const WordList *base) {
+  return (WordListView){.base = base, .idcs = NULL, .nwords = base->nwords};
+}
 
-  memcpy(words, src->words, (unsigned long)src->nwords * sizeof(SL));
-  dst->words = words;
+WordListView WLV_from_idcs(const WordList *base, long *idcs, long n_words) {
+  for (long i = 0; i < n_words; ++i) {
+    assert(idcs[i] >= 0 && idcs[i] < base->nwords);
+  }
+  return (WordListView){.base = base, .idcs = idcs, .nwords = n_words};
+}
 
-  memcpy(chars, src->chars, (unsigned long)dst->nchars);
-  dst->chars = chars;
+long WLV_id(const WordListView *v, long i) {
+  assert(i >= 0 && i < v->nwords);
+  return v->idcs ? v->idcs[i] : i;
 }
 
-WordList WL_sample(const WordList *wl, const long *idcs, long n_words) {
-  assert(n_words <= wl->nwords);
+long WL_filter(const WordList *wl, CharMask mask, long *idcs) {
+  long n = 0;
+  // branchless and without calls so the compiler can vectorize the mask test
+  for (long i = 0; i < wl->nwords; ++i) {
+    const CharMask m = wl->masks[i];
+    idcs[n] = i;
+    n += ((m.lo & mask.lo) | (m.hi & mask.hi)) != 0;
+  }
+  return n;
+}
 
-  WordList ret = {0};
-  ret.nwords = n_words;
+#define N_BIGRAMS (N_CHARS * N_CHARS)
 
-  for (long i = 0; i < n_words; ++i) {
-    ret.nchars += wl->words[idcs[i]].len;
+static int bigram_id_at(SL word, int pos) {
+  if (!is_key(word.start[pos]) || !is_key(word.start[pos + 1])) {
+    return -1;
+  }
+  return char_idx(word.start[pos]) * N_CHARS + char_idx(word.start[pos + 1]);
+}
+
+BigramPostings BP_build(const WordList *wl) {
+  uint32_t *starts = calloc(N_BIGRAMS + 1, sizeof(uint32_t));
+  // last word a bigram was counted for, deduplicates bigrams within a word
+  long *seen = malloc(N_BIGRAMS * sizeof(long));
+  for (long i = 0; i < N_BIGRAMS; ++i) {
+    seen[i] = -1;
   }
 
-  char* chars = malloc((unsigned long)ret.nchars * sizeof(char));
-  SL *words = malloc((unsigned long)n_words * sizeof(SL));
-  long cur_idx = 0;
-  for (long i = 0; i < n_words; ++i) {
-    words[i] = wl->words[idcs[i]];
-    memcpy(&chars[cur_idx], &words[i].start,
-           (unsigned long)words[i].len);
-    cur_idx += words[i].len;
+  // count words per bigram, shifted by one for the prefix sum
+  for (long wi = 0; wi < wl->nwords; ++wi) {
+    for (int c = 0; c < wl->words[wi].len - 1; ++c) {
+      const int id = bigram_id_at(wl->words[wi], c);
+      if (id >= 0 && seen[id] != wi) {
+        seen[id] = wi;
+        ++starts[id + 1];
+      }
+    }
+  }
+  for (long i = 0; i < N_BIGRAMS; ++i) {
+    starts[i + 1] += starts[i];
+  }
+
+  uint32_t *word_ids = malloc((starts[N_BIGRAMS] + 1) * sizeof(uint32_t));
+  uint32_t *fill = malloc(N_BIGRAMS * sizeof(uint32_t));
+  memcpy(fill, starts, N_BIGRAMS * sizeof(uint32_t));
+  for (long i = 0; i < N_BIGRAMS; ++i) {
+    seen[i] = -1;
+  }
+  for (long wi = 0; wi < wl->nwords; ++wi) {
+    for (int c = 0; c < wl->words[wi].len - 1; ++c) {
+      const int id = bigram_id_at(wl->words[wi], c);
+      if (id >= 0 && seen[id] != wi) {
+        seen[id] = wi;
+        word_ids[fill[id]++] = (uint32_t)wi;
+      }
+    }
+  }
+
+  free(fill);
+  free(seen);
+  return (BigramPostings){.starts = starts, .word_ids = word_ids};
+}
+
+const uint32_t *BP_words(const BigramPostings *bp, int bigram_id,
+                         long *n_words) {
+  assert(bigram_id >= 0 && bigram_id < N_BIGRAMS);
+  *n_words = bp->starts[bigram_id + 1] - bp->starts[bigram_id];
+  return &bp->word_ids[bp->starts[bigram_id]];
+}
+
+void BP_free(BigramPostings bp) {
+  if (bp.mapped) {
+    return;
   }
-  ret.chars = chars;
-  ret.words = words;
-  return ret;
+  free((void *)bp.starts);
+  free((void *)bp.word_ids);
 }
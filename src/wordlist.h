@@ -1,34 +1,111 @@
 #ifndef WORDLIST_H
 #define WORDLIST_H
 
+#include "keys.h"
 #include "sl.h"
+#include "stdint.h"
 #include "stdio.h"
 
 typedef struct {
   const char *chars;
   const SL *words;
+  const CharMask *masks; //< keys contained in each word
+  const float *freqs;    //< usage frequency of each word, NULL if unknown
   long nwords;
   long nchars;
+  const void *map; //< backing file mapping, NULL if chars is malloced
+  long map_size;
 } WordList;
 
+/**
+ * Inverted index from bigram id (first * N_CHARS + second) to the ids of all
+ * words containing that bigram, stored as compressed rows.
+ */
+typedef struct {
+  const uint32_t *starts;   //< N_CHARS * N_CHARS + 1 offsets into word_ids
+  const uint32_t *word_ids; //< word ids, ascending per bigram
+  bool mapped; //< views into a compiled word list, nothing to free
+} BigramPostings;
+
 void exit_err_file(const char *msg, const char *fname);
 long get_fsize_or_panic(FILE *f, const char *fname);
 
 /**
  * @brief get WordList from words in a file
+ *
+ * The file is mapped read-only and the words are views into the mapping,
+ * so no copy of the file contents is made.
+ *
+ * Words are separated by spaces or newlines. A line of the form
+ * `word<TAB>count` annotates the word with its usage count, in that case all
+ * words without a count get a count of 0.
  */
-WordList get_malloced_wordlist(const char *fname);
+WordList get_mmapped_wordlist(const char *fname);
 
 /**
- * @brief free malloced WordList data
+ * @brief free malloced / unmap mapped WordList data
  */
 void WL_free(WordList wl);
 
 /**
- * @brief deep copy src to dst
+ * Selection of words from a WordList, by index into the base list.
+ *
+ * A view borrows both its base list and its index array, usually from the
+ * lesson arena, so it never has to be freed.
+ */
+typedef struct {
+  const WordList *base;
+  long *idcs; //< base word ids, NULL to select all words of base in order
+  long nwords;
+} WordListView;
+
+/**
+ * @brief view of all words in base, without allocating
+ */
+WordListView WLV_all(const WordList *base);
+
+/**
+ * @brief view of the words at idcs in base
+ *
+ * @param base WordList to select from
+ * @param idcs base word ids, have to outlive the view
+ * @param n_words number of ids
+ */
+WordListView WLV_from_idcs(const WordList *base, long *idcs, long n_words);
+
+/**
+ * @brief base word id of the i-th word in the view
+ */
+long WLV_id(const WordListView *v, long i);
+
+/**
+ * @brief collect indices of all words that contain any key in mask
+ *
+ * @param wl WordList to filter
+ * @param mask keys to look for
+ * @param idcs output, needs space for wl->nwords indices
+ *
+ * @return number of matching words written to idcs
+ */
+long WL_filter(const WordList *wl, CharMask mask, long *idcs);
+
+/**
+ * @brief build bigram to word inverted index by scanning all words
+ */
+BigramPostings BP_build(const WordList *wl);
+
+/**
+ * @brief get words containing a bigram
+ *
+ * @param bp postings to query
+ * @param bigram_id first * N_CHARS + second
+ * @param n_words output, number of returned word ids
+ *
+ * @return word ids containing the bigram
  */
-void WL_deepcopy(const WordList* src, WordList* dst);
+const uint32_t *BP_words(const BigramPostings *bp, int bigram_id,
+                         long *n_words);
 
-WordList WL_sample(const WordList* wl, const long* idcs, long n_words);
+void BP_free(BigramPostings bp);
 
 #endif // WORDLIST_H